@@ -0,0 +1,381 @@
+/**
+ * @file bench_kernels.cpp
+ * @brief micro-benchmarks of the planner hot kernels
+ *
+ * Each benchmark reports the time per operation and the heap allocations per
+ * operation as `allocs/op`. The inputs are generated from a fixed seed and
+ * cycled through, so that the numbers are comparable between runs. Run with
+ * `--benchmark_filter=<regex>` to select the kernels.
+ */
+#include <benchmark/benchmark.h>
+#include <mpl_collision/map_generator.h>
+#include <mpl_planner/env/env_map.h>
+#include <mpl_traj_solver/poly_solver.h>
+#include <atomic>
+#include <random>
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+#endif
+
+/// Number of heap allocations since the start of the program
+static std::atomic<size_t> num_allocs{0};
+
+#ifdef __GLIBC__
+// Count at malloc, which covers both operator new and the Eigen allocator
+extern "C" {
+void *malloc(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+void *realloc(void *ptr, size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+#else
+void *operator new(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+#endif
+
+/**
+ * @brief Report the allocations of the timed loop as allocs/op
+ *
+ * The allocations between `pause()` and `resume()` are excluded together with
+ * the timing.
+ */
+class AllocCounter {
+ public:
+  explicit AllocCounter(benchmark::State &state)
+      : state_(state), start_(num_allocs) {}
+  ~AllocCounter() {
+    state_.counters["allocs/op"] = benchmark::Counter(
+        num_allocs - start_ - excluded_, benchmark::Counter::kAvgIterations);
+  }
+  void pause() {
+    state_.PauseTiming();
+    paused_ = num_allocs;
+  }
+  void resume() {
+    excluded_ += num_allocs - paused_;
+    state_.ResumeTiming();
+  }
+
+ private:
+  benchmark::State &state_;
+  size_t start_;
+  size_t paused_{0};
+  size_t excluded_{0};
+};
+
+/// Number of inputs that each benchmark cycles through, a power of 2
+static const int num_inputs = 1024;
+
+/// Random forest that covers a tenth of the map
+template <int Dim>
+std::shared_ptr<MPL::MapUtil<Dim>> random_map(const Veci<Dim> &dim,
+                                              decimal_t res, int seed) {
+  MPL::MapGenerator<Dim> generator(dim.template cast<decimal_t>() * res, res,
+                                   seed);
+  return generator.forest(0.1, 0.2, 0.6);
+}
+
+/// Planning problem in a 2D map shared by the env benchmarks
+struct Scene {
+  explicit Scene(Control::Control control, bool clearance = false) {
+    std::mt19937 gen(1);
+    map_util = random_map<2>(Vec2i(400, 400), 0.1, 1);
+    if (clearance)
+      map_util->updateClearance();
+    env = std::make_shared<MPL::env_map<2>>(map_util);
+    env->set_v_max(2);
+    env->set_a_max(2);
+    env->set_j_max(4);
+    env->set_yaw_max(M_PI);
+    env->set_dt(0.5);
+    env->set_heur_ignore_dynamics(false);
+    env->set_robot_radius(clearance ? 0.2 : 0);
+
+    // control input on the highest derivative of the control
+    const bool use_yaw = Waypoint2D(control).use_yaw;
+    const decimal_t u_max =
+      Waypoint2D(control).use_jrk ? 4 : Waypoint2D(control).use_acc ? 2 : 1;
+    for (decimal_t dx = -u_max; dx <= u_max; dx += u_max) {
+      for (decimal_t dy = -u_max; dy <= u_max; dy += u_max) {
+        if (use_yaw) {
+          for (decimal_t dyaw = -0.5; dyaw <= 0.5; dyaw += 0.5)
+            U.push_back(Vec3f(dx, dy, dyaw));
+        } else
+          U.push_back(Vec2f(dx, dy));
+      }
+    }
+    env->set_u(U);
+
+    std::uniform_real_distribution<decimal_t> u(-1, 1);
+    auto random_state = [&]() {
+      Waypoint2D w(control);
+      do {
+        w.pos = Vec2f(20 + 18 * u(gen), 20 + 18 * u(gen));
+      } while (!env->is_free(w.pos));
+      w.vel = w.use_vel ? Vec2f(u(gen), u(gen)) : Vec2f::Zero();
+      w.acc = w.use_acc ? Vec2f(u(gen), u(gen)) : Vec2f::Zero();
+      w.jrk = w.use_jrk ? Vec2f(u(gen), u(gen)) : Vec2f::Zero();
+      w.yaw = w.use_yaw ? M_PI * u(gen) : 0;
+      return w;
+    };
+    for (int i = 0; i < num_inputs; i++)
+      states.push_back(random_state());
+    goal = random_state();
+    env->set_goal(goal);
+    for (int i = 0; i < num_inputs; i++)
+      prs.push_back(
+          Primitive2D(states[i], U[gen() % U.size()], 0.5));
+  }
+
+  std::shared_ptr<MPL::OccMapUtil> map_util;
+  std::shared_ptr<MPL::env_map<2>> env;
+  vec_E<VecDf> U;
+  vec_E<Waypoint2D> states;
+  Waypoint2D goal;
+  vec_E<Primitive2D> prs;
+};
+
+/// Controls benchmarked by name
+static const std::vector<std::pair<std::string, Control::Control>> controls = {
+    {"VEL", Control::VEL},         {"ACC", Control::ACC},
+    {"JRK", Control::JRK},         {"SNP", Control::SNP},
+    {"VELxYAW", Control::VELxYAW}, {"ACCxYAW", Control::ACCxYAW},
+    {"JRKxYAW", Control::JRKxYAW}, {"SNPxYAW", Control::SNPxYAW}};
+
+static void BM_state_to_idx(benchmark::State &state, Control::Control control) {
+  Scene scene(control);
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        scene.env->state_to_idx(scene.states[i++ & (num_inputs - 1)]));
+}
+
+static void BM_get_succ(benchmark::State &state, Control::Control control,
+                        bool clearance) {
+  Scene scene(control, clearance);
+  vec_E<Waypoint2D> succ;
+  std::vector<MPL::Key> succ_idx;
+  std::vector<decimal_t> succ_cost;
+  std::vector<int> action_idx;
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state) {
+    scene.env->get_succ(scene.states[i++ & (num_inputs - 1)], succ, succ_idx,
+                        succ_cost, action_idx);
+    benchmark::DoNotOptimize(succ_cost.data());
+  }
+}
+
+static void BM_is_free(benchmark::State &state, Control::Control control,
+                       bool clearance) {
+  Scene scene(control, clearance);
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        scene.env->is_free(scene.prs[i++ & (num_inputs - 1)]));
+}
+
+static void BM_traverse_primitive(benchmark::State &state,
+                                  Control::Control control, bool clearance) {
+  Scene scene(control, clearance);
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        scene.env->traverse_primitive(scene.prs[i++ & (num_inputs - 1)]));
+}
+
+static void BM_cal_heur(benchmark::State &state, Control::Control control) {
+  Scene scene(control);
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(scene.env->cal_heur(
+        scene.states[i++ & (num_inputs - 1)], scene.goal));
+}
+
+static void BM_max_vel(benchmark::State &state, Control::Control control) {
+  Scene scene(control);
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state) {
+    const auto &pr = scene.prs[i++ & (num_inputs - 1)];
+    benchmark::DoNotOptimize(pr.max_vel(0) + pr.max_vel(1));
+  }
+}
+
+template <int Dim>
+static void BM_rayTrace(benchmark::State &state, const Veci<Dim> &dim) {
+  std::mt19937 gen(2);
+  auto map_util = random_map<Dim>(dim, 0.1, 2);
+  const Vecf<Dim> range = dim.template cast<decimal_t>() * 0.1;
+  std::uniform_real_distribution<decimal_t> u(0, 1);
+  vec_E<std::pair<Vecf<Dim>, Vecf<Dim>>> rays;
+  for (int i = 0; i < num_inputs; i++) {
+    Vecf<Dim> p1, p2;
+    for (int k = 0; k < Dim; k++) {
+      p1(k) = u(gen) * range(k);
+      p2(k) = u(gen) * range(k);
+    }
+    rays.push_back(std::make_pair(p1, p2));
+  }
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state) {
+    const auto &ray = rays[i++ & (num_inputs - 1)];
+    benchmark::DoNotOptimize(map_util->rayTrace(ray.first, ray.second));
+  }
+}
+
+template <int Dim>
+static void BM_dilate(benchmark::State &state, const Veci<Dim> &dim) {
+  auto map_util = random_map<Dim>(dim, 0.1, 3);
+  // neighbors within 2 cells
+  vec_Veci<Dim> neighbors;
+  for (int idx = 0; idx < std::pow(5, Dim); idx++) {
+    Veci<Dim> n;
+    int r = idx;
+    for (int k = 0; k < Dim; k++) {
+      n(k) = r % 5 - 2;
+      r /= 5;
+    }
+    if (n.squaredNorm() <= 4 && n != Veci<Dim>::Zero())
+      neighbors.push_back(n);
+  }
+  AllocCounter counter(state);
+  for (auto _ : state) {
+    counter.pause();
+    MPL::MapUtil<Dim> util = *map_util;
+    counter.resume();
+    util.dilate(neighbors);
+  }
+}
+
+static void BM_trajectory_evaluate(benchmark::State &state, bool scaled) {
+  Scene scene(Control::ACC);
+  // chain of primitives from the first state
+  vec_E<Primitive2D> prs;
+  Waypoint2D w = scene.states.front();
+  for (int i = 0; i < 50; i++) {
+    prs.push_back(Primitive2D(w, scene.U[i % scene.U.size()], 0.5));
+    w = prs.back().evaluate(0.5);
+  }
+  Trajectory2D traj(prs);
+  if (scaled)
+    traj.scale(0.5, 1);
+  std::mt19937 gen(4);
+  std::uniform_real_distribution<decimal_t> u(0, traj.getTotalTime());
+  std::vector<decimal_t> ts(num_inputs);
+  for (auto &t : ts)
+    t = u(gen);
+  Command<2> cmd;
+  int i = 0;
+  AllocCounter counter(state);
+  for (auto _ : state) {
+    traj.evaluate(ts[i++ & (num_inputs - 1)], cmd);
+    benchmark::DoNotOptimize(cmd.pos.data());
+  }
+}
+
+/// Solve with a new time allocation if prepare is true, otherwise reuse the factorization
+static void BM_poly_solve(benchmark::State &state, bool prepare) {
+  const int num_waypoints = state.range(0);
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<decimal_t> u(-1, 1);
+  vec_E<Waypoint2D> waypoints;
+  std::vector<decimal_t> dts;
+  Vec2f pos = Vec2f::Zero();
+  for (int i = 0; i < num_waypoints; i++) {
+    Waypoint2D w(Control::VEL);
+    w.pos = pos;
+    w.vel = w.acc = w.jrk = Vec2f::Zero();
+    w.yaw = 0;
+    waypoints.push_back(w);
+    pos += Vec2f(1 + u(gen), u(gen));
+    if (i > 0)
+      dts.push_back(1 + 0.5 * u(gen));
+  }
+  waypoints.front().control = waypoints.back().control = Control::JRK;
+
+  PolySolver2D solver(3, 3);
+  solver.solve(waypoints, dts);
+  bool shrink = false;
+  AllocCounter counter(state);
+  for (auto _ : state) {
+    if (prepare) {
+      // alternate between two time allocations to defeat the cache
+      shrink = !shrink;
+      for (auto &dt : dts)
+        dt *= shrink ? 0.5 : 2;
+    }
+    benchmark::DoNotOptimize(solver.solve(waypoints, dts));
+  }
+}
+
+int main(int argc, char **argv) {
+  for (const auto &it : controls)
+    benchmark::RegisterBenchmark(("state_to_idx/" + it.first).c_str(),
+                                 BM_state_to_idx, it.second);
+  for (const auto &it : controls)
+    benchmark::RegisterBenchmark(("cal_heur/" + it.first).c_str(), BM_cal_heur,
+                                 it.second);
+  for (const auto &it : controls) {
+    if (it.second != Control::ACC && it.second != Control::JRK &&
+        it.second != Control::ACCxYAW)
+      continue;
+    for (bool clearance : {false, true}) {
+      const std::string suffix =
+        it.first + (clearance ? "/clearance" : "/map");
+      benchmark::RegisterBenchmark(("get_succ/" + suffix).c_str(), BM_get_succ,
+                                   it.second, clearance);
+      benchmark::RegisterBenchmark(("is_free/" + suffix).c_str(), BM_is_free,
+                                   it.second, clearance);
+      benchmark::RegisterBenchmark(("traverse_primitive/" + suffix).c_str(),
+                                   BM_traverse_primitive, it.second, clearance);
+    }
+    benchmark::RegisterBenchmark(("max_vel/" + it.first).c_str(), BM_max_vel,
+                                 it.second);
+  }
+  benchmark::RegisterBenchmark("rayTrace/2D", BM_rayTrace<2>, Vec2i(400, 400));
+  benchmark::RegisterBenchmark("rayTrace/3D", BM_rayTrace<3>,
+                               Vec3i(200, 200, 40));
+  benchmark::RegisterBenchmark("dilate/2D", BM_dilate<2>, Vec2i(400, 400))
+      ->Unit(benchmark::kMicrosecond);
+  benchmark::RegisterBenchmark("dilate/3D", BM_dilate<3>, Vec3i(200, 200, 40))
+      ->Unit(benchmark::kMillisecond);
+  benchmark::RegisterBenchmark("Trajectory::evaluate/unscaled",
+                               BM_trajectory_evaluate, false);
+  benchmark::RegisterBenchmark("Trajectory::evaluate/scaled",
+                               BM_trajectory_evaluate, true);
+  benchmark::RegisterBenchmark("PolySolver::solve/prepare", BM_poly_solve, true)
+      ->Arg(4)->Arg(32)->Arg(256)->Unit(benchmark::kMicrosecond);
+  benchmark::RegisterBenchmark("PolySolver::solve/cached", BM_poly_solve, false)
+      ->Arg(4)->Arg(32)->Arg(256)->Unit(benchmark::kMicrosecond);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,489 @@
+/**
+ * @file bench_planner.cpp
+ * @brief end-to-end planning benchmark over a scenario set
+ *
+ * The scenarios are `data/corridor.yaml`, the maps from `MapGenerator` and
+ * the map files given by `--map`, such as the output of `gen_map`.
+ * Each case plans one query with `OccMapPlanner` or `VoxelMapPlanner` for a
+ * control mode and a search algorithm, and repeats it to get the percentiles
+ * of the planning time. The results are written to a JSON file, which can be
+ * compared against a stored baseline. Without `--out`, the results are
+ * written to `bench_planner.json` in the build directory:
+ *
+ *     bench_planner [--repeat N] [--filter substr] [--out results.json]
+ *                   [--stats] [--trace trace.json] [--max-states N]
+ *                   [--timeout-us N]
+ *                   [--map file.yaml]
+ *     bench_planner --compare baseline.json results.json [--threshold 0.1]
+ *
+ * The compare mode returns a non-zero code if any case regresses.
+ */
+#include <mpl_collision/map_generator.h>
+#include <mpl_planner/planner/map_planner.h>
+#include "../test/read_map.hpp"
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#ifndef MPL_DATA_DIR
+#define MPL_DATA_DIR "data"
+#endif
+/// Directory of the default output, the build directory with cmake
+#ifndef MPL_BENCH_OUT_DIR
+#define MPL_BENCH_OUT_DIR "."
+#endif
+
+/// Peak resident set size in KB since the last `reset_peak_rss()`
+long peak_rss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::stol(line.substr(6));
+  }
+  // the peak of the whole process if the status is not available
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * @brief Reset the peak resident set size to the current one
+ *
+ * It only works on Linux, the free memory of the heap is released first so
+ * that the previous cases do not count.
+ */
+void reset_peak_rss() {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs)
+    clear_refs << "5";
+}
+
+/// Map with a start and a goal
+template <int Dim> struct Scenario {
+  std::string name;
+  std::shared_ptr<MPL::MapUtil<Dim>> map_util;
+  Vecf<Dim> start;
+  Vecf<Dim> goal;
+};
+
+/// Scenario of the generated map, start and goal are kept away from obstacles
+template <int Dim>
+Scenario<Dim> generated_scenario(const std::string &name,
+                                 MPL::MapGenerator<Dim> &generator,
+                                 const std::shared_ptr<MPL::MapUtil<Dim>> &map_util) {
+  Scenario<Dim> scenario;
+  scenario.name = name;
+  const Vecf<Dim> range = map_util->getDim().template cast<decimal_t>() * map_util->getRes();
+  const auto pairs = generator.startGoal(*map_util, 1, 0.3,
+                                         0.5 * range.template topRows<2>().norm());
+  if (pairs.empty())
+    return scenario;
+  scenario.map_util = map_util;
+  scenario.start = pairs.front().first;
+  scenario.goal = pairs.front().second;
+  return scenario;
+}
+
+/// Scenario from the yaml map file, the map util is empty if it fails
+template <int Dim>
+Scenario<Dim> file_scenario(const std::string &name, const std::string &file) {
+  Scenario<Dim> scenario;
+  scenario.name = name;
+  MapReader<Veci<Dim>, Vecf<Dim>> reader(file);
+  if (!reader.exist())
+    return scenario;
+  scenario.map_util = std::make_shared<MPL::MapUtil<Dim>>();
+  scenario.map_util->setMap(reader.origin(), reader.dim(), reader.data(),
+                            reader.resolution());
+  scenario.map_util->freeUnknown();
+  for (int i = 0; i < Dim; i++) {
+    scenario.start(i) = reader.start(i);
+    scenario.goal(i) = reader.goal(i);
+  }
+  return scenario;
+}
+
+/// Result of one case
+struct Result {
+  std::string name;
+  bool success = false;
+  bool partial = false;
+  int expansions = 0;
+  size_t states = 0;
+  int evicted = 0;
+  std::vector<double> times;
+  long peak_rss_kb = 0;
+  decimal_t cost = 0;
+  decimal_t traj_time = 0;
+  MPL::SearchStats stats;
+  MPL::StateSpaceMemory memory;
+};
+
+/// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  int k = std::ceil(p / 100 * sorted.size()) - 1;
+  return sorted[std::min<int>(std::max(k, 0), sorted.size() - 1)];
+}
+
+/// Control modes by name
+const std::vector<std::pair<std::string, Control::Control>> controls = {
+    {"VEL", Control::VEL},         {"ACC", Control::ACC},
+    {"JRK", Control::JRK},         {"VELxYAW", Control::VELxYAW},
+    {"ACCxYAW", Control::ACCxYAW}, {"JRKxYAW", Control::JRKxYAW}};
+
+/// Plan the scenario with the control and the search algorithm for repeat times
+template <int Dim>
+Result run(const Scenario<Dim> &scenario, const std::string &control_name,
+           Control::Control control, bool lpastar, int repeat,
+           size_t max_states, long timeout_us) {
+  Result result;
+  result.name = scenario.name + "/" + control_name +
+                (lpastar ? "/lpastar" : "/astar");
+
+  Waypoint<Dim> start(control), goal(control);
+  start.pos = scenario.start;
+  start.vel = start.acc = start.jrk = Vecf<Dim>::Zero();
+  start.yaw = 0;
+  goal.pos = scenario.goal;
+  goal.vel = goal.acc = goal.jrk = Vecf<Dim>::Zero();
+  goal.yaw = 0;
+
+  // control input on the highest derivative, plus the yaw rate
+  const decimal_t u = start.use_jrk ? 1 : 0.5;
+  vec_E<VecDf> U;
+  Veci<Dim> n = Veci<Dim>::Constant(-1);
+  for (int idx = 0; idx < std::pow(3, Dim); idx++) {
+    int r = idx;
+    for (int i = 0; i < Dim; i++) {
+      n(i) = r % 3 - 1;
+      r /= 3;
+    }
+    VecDf v(start.use_yaw ? Dim + 1 : Dim);
+    v.head(Dim) = u * n.template cast<decimal_t>();
+    if (!start.use_yaw)
+      U.push_back(v);
+    else {
+      for (decimal_t dyaw = -0.5; dyaw <= 0.5; dyaw += 0.5) {
+        v(Dim) = dyaw;
+        U.push_back(v);
+      }
+    }
+  }
+
+  const decimal_t w = 10;
+  MPL::MapPlanner<Dim> planner(false);
+  planner.setMapUtil(scenario.map_util);
+  planner.setVmax(1.0);
+  planner.setAmax(1.0);
+  planner.setJmax(1.0);
+  planner.setYawmax(M_PI / 2);
+  planner.setDyaw(0.5);
+  planner.setDt(1.0);
+  planner.setW(w);
+  planner.setU(U);
+  planner.setMaxNum(20000);
+  planner.setMemoryBudget(max_states);
+  planner.setTimeout(timeout_us);
+  if (lpastar)
+    planner.setLPAstar(true);
+
+  reset_peak_rss();
+  for (int i = 0; i < repeat; i++) {
+    planner.reset();
+    const auto t0 = std::chrono::steady_clock::now();
+    result.success = planner.plan(start, goal);
+    result.partial = planner.isPartial();
+    result.times.push_back(std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - t0)
+                               .count());
+  }
+  result.peak_rss_kb = peak_rss();
+  std::sort(result.times.begin(), result.times.end());
+
+  result.expansions = planner.getExpandedNum();
+  result.states = planner.getStateNum();
+  result.stats = planner.getSearchStats();
+  result.memory = planner.getMemoryStats();
+  result.evicted = planner.getEvictedNum();
+  if (result.partial)
+    result.traj_time = planner.getTraj().getTotalTime();
+  if (result.success) {
+    const auto traj = planner.getTraj();
+    const Control::Control position_control =
+        static_cast<Control::Control>(control & ~1);
+    result.traj_time = traj.getTotalTime();
+    result.cost = traj.J(position_control) + w * result.traj_time;
+  }
+  return result;
+}
+
+/// Write results to a JSON file
+bool write_json(const std::string &file, const std::vector<Result> &results,
+                int repeat) {
+  FILE *f = fopen(file.c_str(), "w");
+  if (!f)
+    return false;
+  fprintf(f, "{\n  \"repeat\": %d,\n  \"cases\": [\n", repeat);
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto &r = results[i];
+    fprintf(f, "    {\"name\": \"%s\", \"success\": %s, \"partial\": %s, "
+               "\"expansions\": %d, \"states\": %zu, \"evicted\": %d,\n",
+            r.name.c_str(), r.success ? "true" : "false",
+            r.partial ? "true" : "false", r.expansions, r.states, r.evicted);
+    fprintf(f, "     \"time_ms\": {\"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+               "\"p99\": %.4f, \"max\": %.4f},\n",
+            percentile(r.times, 0), percentile(r.times, 50),
+            percentile(r.times, 90), percentile(r.times, 99),
+            percentile(r.times, 100));
+    const auto &m = r.memory;
+    fprintf(f, "     \"memory\": {\"bytes\": %zu, \"peak_bytes\": %zu, "
+               "\"bytes_per_state\": %.1f, \"state_bytes\": %zu, "
+               "\"succ_bytes\": %zu, \"pred_bytes\": %zu, \"hash_bytes\": %zu, "
+               "\"heap_bytes\": %zu, \"succ_edges\": %zu, \"pred_edges\": %zu, "
+               "\"load_factor\": %.3f},\n",
+            m.total(), m.peak_bytes, m.bytes_per_state(), m.state_bytes,
+            m.succ_bytes, m.pred_bytes, m.hash_bytes, m.heap_bytes,
+            m.succ_edges, m.pred_edges, m.load_factor);
+    fprintf(f, "     \"peak_rss_kb\": %ld, \"cost\": %.9g, \"traj_time\": %.9g}%s\n",
+            r.peak_rss_kb, r.cost, r.traj_time,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  return true;
+}
+
+/**
+ * @brief Compare the results against the baseline
+ *
+ * A case regresses if it fails where the baseline succeeds, if its median
+ * time, peak RSS, number of states or peak state space bytes grows by more
+ * than the relative threshold, or if its expansions or cost grow at all.
+ */
+int compare(const std::string &baseline_file, const std::string &current_file,
+            double threshold) {
+  YAML::Node baseline, current;
+  try {
+    baseline = YAML::LoadFile(baseline_file);
+    current = YAML::LoadFile(current_file);
+  } catch (const YAML::Exception &e) {
+    printf(ANSI_COLOR_RED "Cannot load results: %s\n" ANSI_COLOR_RESET,
+           e.what());
+    return 2;
+  }
+
+  std::map<std::string, YAML::Node> base_cases;
+  for (size_t i = 0; i < baseline["cases"].size(); i++) {
+    const YAML::Node c = baseline["cases"][i];
+    base_cases[c["name"].as<std::string>()] = c;
+  }
+
+  int num_regressions = 0;
+  printf("%-28s %10s %10s %8s %10s %10s\n", "case", "p50 ms", "base ms",
+         "ratio", "expansions", "rss kb");
+  for (size_t i = 0; i < current["cases"].size(); i++) {
+    const YAML::Node c = current["cases"][i];
+    const std::string name = c["name"].as<std::string>();
+    if (!base_cases.count(name)) {
+      printf("%-28s new case\n", name.c_str());
+      continue;
+    }
+    const auto &b = base_cases[name];
+    const double t = c["time_ms"]["p50"].as<double>();
+    const double tb = b["time_ms"]["p50"].as<double>();
+    std::vector<std::string> reasons;
+    if (b["success"].as<bool>() && !c["success"].as<bool>())
+      reasons.push_back("fails");
+    if (t > tb * (1 + threshold))
+      reasons.push_back("time");
+    if (c["expansions"].as<int>() > b["expansions"].as<int>())
+      reasons.push_back("expansions");
+    if (c["states"].as<double>() > b["states"].as<double>() * (1 + threshold))
+      reasons.push_back("states");
+    if (c["peak_rss_kb"].as<double>() >
+        b["peak_rss_kb"].as<double>() * (1 + threshold))
+      reasons.push_back("rss");
+    if (c["memory"] && b["memory"] &&
+        c["memory"]["peak_bytes"].as<double>() >
+            b["memory"]["peak_bytes"].as<double>() * (1 + threshold))
+      reasons.push_back("memory");
+    if (c["success"].as<bool>() && b["success"].as<bool>() &&
+        c["cost"].as<double>() > b["cost"].as<double>() * (1 + 1e-9))
+      reasons.push_back("cost");
+
+    printf("%-28s %10.3f %10.3f %8.2f %10d %10ld", name.c_str(), t, tb,
+           tb > 0 ? t / tb : 0, c["expansions"].as<int>(),
+           c["peak_rss_kb"].as<long>());
+    if (!reasons.empty()) {
+      num_regressions++;
+      printf(ANSI_COLOR_RED "  REGRESSION:");
+      for (const auto &it : reasons)
+        printf(" %s", it.c_str());
+      printf(ANSI_COLOR_RESET);
+    }
+    printf("\n");
+  }
+
+  if (num_regressions > 0) {
+    printf(ANSI_COLOR_RED "%d regressions!\n" ANSI_COLOR_RESET,
+           num_regressions);
+    return 1;
+  }
+  printf(ANSI_COLOR_GREEN "No regression.\n" ANSI_COLOR_RESET);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int repeat = 5;
+  double threshold = 0.1;
+  bool show_stats = false;
+  size_t max_states = 0;
+  long timeout_us = 0;
+  std::string filter, out = std::string(MPL_BENCH_OUT_DIR) + "/bench_planner.json",
+      trace_file;
+  std::vector<std::string> compare_files, map_files;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--repeat" && i + 1 < argc)
+      repeat = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--filter" && i + 1 < argc)
+      filter = argv[++i];
+    else if (arg == "--map" && i + 1 < argc)
+      map_files.push_back(argv[++i]);
+    else if (arg == "--out" && i + 1 < argc)
+      out = argv[++i];
+    else if (arg == "--stats")
+      show_stats = true;
+    else if (arg == "--max-states" && i + 1 < argc)
+      max_states = std::atol(argv[++i]);
+    else if (arg == "--timeout-us" && i + 1 < argc)
+      timeout_us = std::atol(argv[++i]);
+    else if (arg == "--trace" && i + 1 < argc)
+      trace_file = argv[++i];
+    else if (arg == "--threshold" && i + 1 < argc)
+      threshold = std::atof(argv[++i]);
+    else if (arg == "--compare" && i + 2 < argc) {
+      compare_files.push_back(argv[++i]);
+      compare_files.push_back(argv[++i]);
+    } else {
+      printf("Usage: %s [--repeat N] [--filter substr] [--out file] "
+             "[--map file.yaml] [--stats] [--trace file]\n"
+             "       [--max-states N] [--timeout-us N]\n"
+             "       %s --compare baseline.json results.json [--threshold r]\n",
+             argv[0], argv[0]);
+      return 2;
+    }
+  }
+  if (!compare_files.empty())
+    return compare(compare_files[0], compare_files[1], threshold);
+  if (show_stats && !MPL::SearchStats::enabled)
+    printf(ANSI_COLOR_YELLOW "Search stats are not compiled, rebuild with "
+           "-DMPL_SEARCH_STATS=ON\n" ANSI_COLOR_RESET);
+#ifndef MPL_TRACE
+  if (!trace_file.empty())
+    printf(ANSI_COLOR_YELLOW "Trace events are not compiled, rebuild with "
+           "-DMPL_TRACE=ON\n" ANSI_COLOR_RESET);
+#endif
+  MPL::Trace::enable(!trace_file.empty());
+
+  std::vector<Scenario<2>> scenarios_2d;
+  std::vector<Scenario<3>> scenarios_3d;
+  scenarios_2d.push_back(file_scenario<2>(
+      "corridor", std::string(MPL_DATA_DIR) + "/corridor.yaml"));
+  MPL::OccMapGenerator generator_2d(Vec2f(20, 20), 0.1, 1);
+  scenarios_2d.push_back(generated_scenario<2>(
+      "forest2d", generator_2d, generator_2d.forest(0.1, 0.2, 0.6)));
+  scenarios_2d.push_back(generated_scenario<2>(
+      "maze2d", generator_2d, generator_2d.maze(4, 0.3)));
+  scenarios_2d.push_back(generated_scenario<2>(
+      "gap2d", generator_2d, generator_2d.narrowGap(3, 1, 0.3)));
+  MPL::VoxelMapGenerator generator_3d(Vec3f(12, 12, 3), 0.2, 2);
+  scenarios_3d.push_back(generated_scenario<3>(
+      "forest3d", generator_3d, generator_3d.forest(0.1, 0.2, 0.6)));
+  scenarios_3d.push_back(generated_scenario<3>(
+      "urban3d", generator_3d, generator_3d.urban(2, 1.5, 1, 3)));
+  for (const auto &file : map_files) {
+    // the dimension is decided by the origin
+    const int dim = YAML::LoadFile(file)[2]["origin"].size();
+    if (dim == 3)
+      scenarios_3d.push_back(file_scenario<3>(file, file));
+    else
+      scenarios_2d.push_back(file_scenario<2>(file, file));
+  }
+  for (const auto &s : scenarios_2d)
+    if (!s.map_util) {
+      printf(ANSI_COLOR_RED "Cannot load scenario [%s]!\n" ANSI_COLOR_RESET,
+             s.name.c_str());
+      return 2;
+    }
+  for (const auto &s : scenarios_3d)
+    if (!s.map_util) {
+      printf(ANSI_COLOR_RED "Cannot load scenario [%s]!\n" ANSI_COLOR_RESET,
+             s.name.c_str());
+      return 2;
+    }
+
+  std::vector<Result> results;
+  auto report = [&](const Result &r) {
+    printf("%-28s success: %d, expansions: %6d, states: %7zu, p50: %9.3f ms, "
+           "p90: %9.3f ms, rss: %7ld kb, mem: %7zu kb (%5.0f B/state), "
+           "cost: %.3f\n",
+           r.name.c_str(), r.success, r.expansions, r.states,
+           percentile(r.times, 50), percentile(r.times, 90), r.peak_rss_kb,
+           r.memory.peak_bytes / 1024, r.memory.bytes_per_state(), r.cost);
+    if (r.evicted > 0)
+      printf("%-28s evicted: %d\n", "", r.evicted);
+    if (r.partial)
+      printf("%-28s partial trajectory of %.2f s\n", "", r.traj_time);
+    if (show_stats)
+      r.memory.print();
+    if (show_stats && MPL::SearchStats::enabled)
+      r.stats.print();
+    results.push_back(r);
+  };
+  auto selected = [&](const std::string &name, const std::string &control,
+                      bool lpastar) {
+    const std::string id =
+        name + "/" + control + (lpastar ? "/lpastar" : "/astar");
+    return id.find(filter) != std::string::npos;
+  };
+  for (bool lpastar : {false, true}) {
+    for (const auto &c : controls) {
+      for (const auto &s : scenarios_2d)
+        if (selected(s.name, c.first, lpastar))
+          report(run(s, c.first, c.second, lpastar, repeat, max_states,
+                     timeout_us));
+      // yaw is only planned in 2D
+      for (const auto &s : scenarios_3d)
+        if (!Waypoint3D(c.second).use_yaw && selected(s.name, c.first, lpastar))
+          report(run(s, c.first, c.second, lpastar, repeat, max_states,
+                     timeout_us));
+    }
+  }
+
+  if (!write_json(out, results, repeat)) {
+    printf(ANSI_COLOR_RED "Cannot write to [%s]!\n" ANSI_COLOR_RESET,
+           out.c_str());
+    return 2;
+  }
+  printf("Results are written to [%s]\n", out.c_str());
+  if (!trace_file.empty() && MPL::Trace::size() > 0) {
+    if (!MPL::Trace::write(trace_file)) {
+      printf(ANSI_COLOR_RED "Cannot write to [%s]!\n" ANSI_COLOR_RESET,
+             trace_file.c_str());
+      return 2;
+    }
+    printf("Trace is written to [%s]\n", trace_file.c_str());
+  }
+  return 0;
+}
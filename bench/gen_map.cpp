@@ -0,0 +1,120 @@
+/**
+ * @file gen_map.cpp
+ * @brief generate a map and a start-goal query into a yaml file
+ *
+ * The output has the same format as `data/corridor.yaml`:
+ *
+ *     gen_map <forest|maze|urban|gap> <output.yaml> [--dim 2|3]
+ *             [--range x y [z]] [--res r] [--seed s] [--radius r]
+ */
+#include <mpl_collision/map_generator.h>
+#include <string>
+
+/// Parameters of the map
+struct Options {
+  std::string type;
+  std::string output;
+  int dim = 2;
+  std::vector<decimal_t> range;
+  decimal_t res = 0.1;
+  unsigned int seed = 0;
+  decimal_t radius = 0.2;
+};
+
+/// Format the vector as space separated values
+template <typename Derived>
+std::string to_string(const Eigen::MatrixBase<Derived> &v) {
+  std::string s;
+  for (int i = 0; i < v.size(); i++)
+    s += (i ? " " : "") + std::to_string(v(i));
+  return s;
+}
+
+template <int Dim> int generate(const Options &opt) {
+  Vecf<Dim> range;
+  for (int i = 0; i < Dim; i++)
+    range(i) = i < (int) opt.range.size() ? opt.range[i] : (i < 2 ? 20 : 4);
+  MPL::MapGenerator<Dim> generator(range, opt.res, opt.seed);
+
+  std::shared_ptr<MPL::MapUtil<Dim>> map_util;
+  if (opt.type == "forest")
+    map_util = generator.forest(0.1, 0.2, 0.6);
+  else if (opt.type == "maze")
+    map_util = generator.maze(2, 0.3);
+  else if (opt.type == "urban")
+    map_util = generator.urban(4, 2, 0.5 * range(Dim - 1), range(Dim - 1));
+  else if (opt.type == "gap")
+    map_util = generator.narrowGap(3, 1, 0.3);
+  else {
+    printf(ANSI_COLOR_RED "Unknown map type [%s]!\n" ANSI_COLOR_RESET,
+           opt.type.c_str());
+    return -1;
+  }
+
+  const auto pairs = generator.startGoal(*map_util, 1, opt.radius,
+                                         0.5 * range.template topRows<2>().norm());
+  if (pairs.empty()) {
+    printf(ANSI_COLOR_RED "Cannot find a start and goal!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+
+  FILE *f = fopen(opt.output.c_str(), "w");
+  if (!f) {
+    printf(ANSI_COLOR_RED "Cannot write to [%s]!\n" ANSI_COLOR_RESET,
+           opt.output.c_str());
+    return -1;
+  }
+  auto write_vec = [&](const char *name, const Vecf<Dim> &v) {
+    fprintf(f, "- %s: [", name);
+    for (int i = 0; i < Dim; i++)
+      fprintf(f, i + 1 < Dim ? "%g, " : "%g]\n", v(i));
+  };
+  write_vec("start", pairs.front().first);
+  write_vec("goal", pairs.front().second);
+  write_vec("origin", map_util->getOrigin());
+  const Veci<Dim> dim = map_util->getDim();
+  fprintf(f, "- dim: [");
+  for (int i = 0; i < Dim; i++)
+    fprintf(f, i + 1 < Dim ? "%d, " : "%d]\n", dim(i));
+  fprintf(f, "- resolution: %g\n- data: [", map_util->getRes());
+  const MPL::Tmap map = map_util->getMap();
+  for (size_t i = 0; i < map.size(); i++)
+    fprintf(f, i + 1 < map.size() ? "%d, " : "%d]\n", map[i]);
+  fclose(f);
+
+  printf("%s map of dim [%s] with start [%s] and goal [%s] is written to [%s]\n",
+         opt.type.c_str(), to_string(dim).c_str(),
+         to_string(pairs.front().first).c_str(),
+         to_string(pairs.front().second).c_str(), opt.output.c_str());
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  bool valid = argc >= 3;
+  for (int i = 3; valid && i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--dim" && i + 1 < argc)
+      opt.dim = std::atoi(argv[++i]);
+    else if (arg == "--range") {
+      while (i + 1 < argc && argv[i + 1][0] != '-')
+        opt.range.push_back(std::atof(argv[++i]));
+    } else if (arg == "--res" && i + 1 < argc)
+      opt.res = std::atof(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc)
+      opt.seed = std::atoi(argv[++i]);
+    else if (arg == "--radius" && i + 1 < argc)
+      opt.radius = std::atof(argv[++i]);
+    else
+      valid = false;
+  }
+  if (!valid || (opt.dim != 2 && opt.dim != 3)) {
+    printf("Usage: %s <forest|maze|urban|gap> <output.yaml> [--dim 2|3]\n"
+           "       [--range x y [z]] [--res r] [--seed s] [--radius r]\n",
+           argv[0]);
+    return -1;
+  }
+  opt.type = argv[1];
+  opt.output = argv[2];
+  return opt.dim == 2 ? generate<2>(opt) : generate<3>(opt);
+}
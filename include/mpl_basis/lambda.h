@@ -9,6 +9,8 @@
 
 #include <mpl_basis/data_type.h>
 #include "math.h"
+#include <algorithm>
+#include <array>
 
 /**
  * @brief Used for scaling, ignored for most case
@@ -48,7 +50,25 @@ class LambdaSeg {
     ti = v1.t;
     tf = v2.t;
 
-    dT = getT(tf) - getT(ti);
+    T0 = getT(ti);
+    dT = getT(tf) - T0;
+
+    // tau at K + 1 evenly spaced actual times, and the slope 1 / lambda there
+    const decimal_t dc[4] = {a(0), a(1), a(2), a(3)};
+    for (int k = 0; k <= K; k++) {
+      const decimal_t s = dT * k / K;
+      const decimal_t c_s[5] = {a(0) / 4, a(1) / 3, a(2) / 2, a(3), -T0 - s};
+      if (k == 0)
+        knots[k] = ti;
+      else if (k == K)
+        knots[k] = tf;
+      else if (s > 0 && dT - s > 0)
+        knots[k] = newton_bisect(c_s, dc, 4, ti, tf, -s);
+      else
+        knots[k] = ti + (tf - ti) * k / K;
+      const decimal_t lambda = evaluate(knots[k]).p;
+      slopes[k] = lambda > 0 ? 1 / lambda : (tf - ti) / std::max<decimal_t>(dT, 1e-12);
+    }
   }
 
   VirtualPoint evaluate(decimal_t tau) const {
@@ -65,11 +85,62 @@ class LambdaSeg {
       a(2) / 2 * t * t + a(3) * t;
   }
 
+  /**
+   * @brief Inverse of getT: tau such that \f$T(\tau) - T(t_i) = s\f$ for \f$s \in [0, dT]\f$
+   *
+   * The cubic Hermite interpolant of the knot table is refined by Newton's
+   * method, each step is kept inside the knot interval. If the segment is
+   * ill-posed (lambda is not positive) and Newton's method does not converge,
+   * the smallest root of the quartic in \f$[t_i, t_f]\f$ is returned.
+   */
+  decimal_t getTau(decimal_t s) const {
+    if (!(dT > 0))
+      return ti;
+    const decimal_t h = dT / K;
+    const decimal_t x = std::min<decimal_t>(std::max<decimal_t>(s / h, 0), K);
+    const int k = std::min((int)x, K - 1);
+    const decimal_t u = x - k;
+    const decimal_t u2 = u * u, u3 = u2 * u;
+    decimal_t tau = (2 * u3 - 3 * u2 + 1) * knots[k] +
+      (u3 - 2 * u2 + u) * h * slopes[k] + (-2 * u3 + 3 * u2) * knots[k + 1] +
+      (u3 - u2) * h * slopes[k + 1];
+    // stop once the step or the residual is at the level of rounding errors
+    const decimal_t c[5] = {a(0) / 4, a(1) / 3, a(2) / 2, a(3), -T0 - s};
+    for (int i = 0; i < 4; i++) {
+      const decimal_t f = polyval(c, 4, tau);
+      if (std::abs(f) <= 1e-14 * polyval_abs(c, 4, tau))
+        return tau;
+      const decimal_t lambda = evaluate(tau).p;
+      if (!(lambda > 0))
+        break;
+      const decimal_t step = f / lambda;
+      tau = std::min(std::max(tau - step, knots[k]), knots[k + 1]);
+      if (std::abs(step) <= 1e-12 * std::max<decimal_t>(1, std::abs(tau)))
+        return tau;
+    }
+
+    Roots ts;
+    solve(c, 4, ts);
+    decimal_t tau_min = std::numeric_limits<decimal_t>::infinity();
+    for (const auto &it : ts) {
+      if (it >= ti && it <= tf)
+        tau_min = std::min(tau_min, it);
+    }
+    return std::isinf(tau_min) ? tau : tau_min;
+  }
+
+  /// Number of intervals in the inverse table
+  static const int K = 32;
+
   Vec4f a; ///<a3, a2, a1, a0
   decimal_t ti;
   decimal_t tf;
 
+  decimal_t T0; ///<getT(ti)
   decimal_t dT;
+
+  std::array<decimal_t, K + 1> knots; ///<tau at actual times \f$k\,dT / K\f$ from the start
+  std::array<decimal_t, K + 1> slopes; ///<\f$d\tau / dT\f$ at the knots
 };
 
 /**
@@ -81,9 +152,11 @@ class Lambda {
   Lambda() {}
 
   Lambda(const std::vector<VirtualPoint>& vs) {
+    Ts.push_back(0);
     for (int i = 0; i < (int)vs.size() - 1; i++) {
       LambdaSeg seg(vs[i], vs[i + 1]);
       segs.push_back(seg);
+      Ts.push_back(Ts.back() + seg.dT);
     }
   }
 
@@ -122,67 +195,61 @@ class Lambda {
   }
 
 
+  /**
+   * @brief Evaluate the segment that contains virtual time tau
+   *
+   * Tau beyond the last segment is evaluated on the last segment.
+   */
   VirtualPoint evaluate(decimal_t tau) const {
     VirtualPoint vt;
-    for (const auto &seg : segs) {
-      if (tau >= seg.ti && tau < seg.tf) {
-        vt = seg.evaluate(tau);
-        break;
-      }
-    }
-    return vt;
+    if (segs.empty())
+      return vt;
+    // the last segment whose start is not after tau
+    auto it = std::upper_bound(
+      segs.begin() + 1, segs.end(), tau,
+      [](decimal_t t, const LambdaSeg &seg) { return t < seg.ti; });
+    return (it - 1)->evaluate(tau);
   }
 
 
   decimal_t getT(decimal_t tau) const {
     if(segs.empty())
       return tau;
-    decimal_t T = 0;
-    for (const auto &seg : segs) {
-      if (tau >= seg.ti && tau <= seg.tf) {
-        T += seg.getT(tau) - seg.getT(seg.ti);
-        return T;
-      }
-      T += seg.dT;
-    }
-    return T;
+    // the first segment that ends at or after tau
+    auto it = std::lower_bound(
+      segs.begin(), segs.end(), tau,
+      [](const LambdaSeg &seg, decimal_t t) { return seg.tf < t; });
+    if (it == segs.end() || tau < it->ti)
+      return Ts.back();
+    return Ts[it - segs.begin()] + it->getT(tau) - it->getT(it->ti);
   }
 
+  /**
+   * @brief Virtual time tau of actual time t
+   *
+   * Time out of scope is clamped to the closer bound. The segment is found by
+   * binary search and the precomputed inverse of the segment gives tau.
+   */
   decimal_t getTau(decimal_t t) const {
     if (!exist())
       return t;
-    decimal_t T = 0;
-    for (const auto &seg : segs) {
-      if (t >= T && t <= T + seg.dT) {
-        decimal_t a = seg.a(0) / 4;
-        decimal_t b = seg.a(1) / 3;
-        decimal_t c = seg.a(2) / 2;
-        decimal_t d = seg.a(3);
-        decimal_t e = T - t - seg.getT(seg.ti);
-
-        std::vector<decimal_t> ts = solve(a, b, c, d, e);
-        for (const auto &it : ts) {
-          if (it >= seg.ti && it <= seg.tf)
-            return it;
-        }
-      }
-      T += seg.dT;
-    }
-
-    printf("error: cannot find tau, t = %f\n", t);
-    return -1;
+    if (!(t > 0))
+      return segs.front().ti;
+    if (t >= Ts.back())
+      return segs.back().tf;
+    // the last segment that starts at or before t
+    const int id = std::upper_bound(Ts.begin(), Ts.end() - 1, t) - Ts.begin() - 1;
+    return segs[id].getTau(t - Ts[id]);
   }
 
 
   decimal_t getTotalTime() const {
-    decimal_t t = 0;
-    for (const auto &seg : segs)
-      t += seg.dT;
-
-    return t;
+    return Ts.empty() ? 0 : Ts.back();
   }
 
   std::vector<LambdaSeg> segs;
+  ///Actual time at the start of each segment, the last one is the total time
+  std::vector<decimal_t> Ts;
 };
 
 #endif
@@ -4,12 +4,16 @@
 
  * Solving real roots for n-th order polynomial:
     if n < 5, the closed form solution will be calculated;
-    if n >= 5, using Eigen Polynomials solver which is slower but correct.
+    if n >= 5, roots are bracketed by the roots of the derivatives and refined
+    by Newton's method safeguarded by bisection.
+ * The solvers taking `Roots` write into a fixed-capacity array on the stack,
+ * the ones returning `std::vector` wrap them for convenience.
  */
 #pragma once
 #include <mpl_basis/data_type.h>
-#include <unsupported/Eigen/Polynomials>
+#include <Eigen/Cholesky>
 #include <iostream>
+#include <limits>
 
 inline decimal_t normalize_angle(decimal_t angle) {
   while(angle > M_PI)
@@ -19,73 +23,125 @@ inline decimal_t normalize_angle(decimal_t angle) {
   return angle;
 }
 
-/// Quadratic equation: \f$b*t^2+c*t+d = 0\f$
-inline std::vector<decimal_t> quad(decimal_t b, decimal_t c, decimal_t d) {
-  std::vector<decimal_t> dts;
+/**
+ * @brief Quadratic equation: \f$b*t^2+c*t+d = 0\f$
+ * @param ts output array with capacity of 2
+ *
+ * Write real roots into ts without allocation, return the number of roots
+ */
+inline int quad(decimal_t b, decimal_t c, decimal_t d, decimal_t *ts) {
   decimal_t p = c * c - 4 * b * d;
   if (p < 0)
-    return dts;
-  else {
-    dts.push_back((-c - sqrt(p)) / (2 * b));
-    dts.push_back((-c + sqrt(p)) / (2 * b));
-    return dts;
-  }
+    return 0;
+  ts[0] = (-c - sqrt(p)) / (2 * b);
+  ts[1] = (-c + sqrt(p)) / (2 * b);
+  return 2;
 }
 
-/// Cubic equation: \f$a*t^3+b*t^2+c*t+d = 0\f$
-inline std::vector<decimal_t> cubic(decimal_t a, decimal_t b, decimal_t c,
-                                    decimal_t d) {
-  std::vector<decimal_t> dts;
+/// Quadratic equation: \f$b*t^2+c*t+d = 0\f$
+inline std::vector<decimal_t> quad(decimal_t b, decimal_t c, decimal_t d) {
+  decimal_t ts[2];
+  const int n = quad(b, c, d, ts);
+  return std::vector<decimal_t>(ts, ts + n);
+}
 
+/**
+ * @brief Cubic equation: \f$a*t^3+b*t^2+c*t+d = 0\f$
+ * @param ts output array with capacity of 3
+ *
+ * Write real roots into ts without allocation, return the number of roots
+ */
+inline int cubic(decimal_t a, decimal_t b, decimal_t c, decimal_t d,
+                 decimal_t *ts) {
   decimal_t a2 = b / a;
   decimal_t a1 = c / a;
   decimal_t a0 = d / a;
-  // printf("a: %f, b: %f, c: %f, d: %f\n", a, b, c, d);
 
   decimal_t Q = (3 * a1 - a2 * a2) / 9;
   decimal_t R = (9 * a1 * a2 - 27 * a0 - 2 * a2 * a2 * a2) / 54;
   decimal_t D = Q * Q * Q + R * R;
-  // printf("R: %f, Q: %f, D: %f\n", R, Q, D);
   if (D > 0) {
     decimal_t S = std::cbrt(R + sqrt(D));
     decimal_t T = std::cbrt(R - sqrt(D));
-    // printf("S: %f, T: %f\n", S, T);
-    dts.push_back(-a2 / 3 + (S + T));
-    return dts;
+    ts[0] = -a2 / 3 + (S + T);
+    return 1;
   } else if (D == 0) {
     decimal_t S = std::cbrt(R);
-    dts.push_back(-a2/3+S+S);
-    dts.push_back(-a2/3-S);
-    return dts;
+    ts[0] = -a2/3+S+S;
+    ts[1] = -a2/3-S;
+    return 2;
   }
   else {
     decimal_t theta = acos(R/sqrt(-Q*Q*Q));
-    dts.push_back(2*sqrt(-Q)*cos(theta/3)-a2/3);
-    dts.push_back(2*sqrt(-Q)*cos((theta+2*M_PI)/3)-a2/3);
-    dts.push_back(2*sqrt(-Q)*cos((theta+4*M_PI)/3)-a2/3);
-    return dts;
+    ts[0] = 2*sqrt(-Q)*cos(theta/3)-a2/3;
+    ts[1] = 2*sqrt(-Q)*cos((theta+2*M_PI)/3)-a2/3;
+    ts[2] = 2*sqrt(-Q)*cos((theta+4*M_PI)/3)-a2/3;
+    return 3;
   }
 }
 
-/// Quartic equation: \f$a*t^4+b*t^3+c*t^2+d*t+e = 0\f$
-inline std::vector<decimal_t> quartic(decimal_t a, decimal_t b, decimal_t c,
-                                      decimal_t d, decimal_t e) {
-  std::vector<decimal_t> dts;
+/// Cubic equation: \f$a*t^3+b*t^2+c*t+d = 0\f$
+inline std::vector<decimal_t> cubic(decimal_t a, decimal_t b, decimal_t c,
+                                    decimal_t d) {
+  decimal_t ts[3];
+  const int n = cubic(a, b, c, d, ts);
+  return std::vector<decimal_t>(ts, ts + n);
+}
+
+/**
+ * @brief Fixed-capacity array of real roots
+ *
+ * It lives on the stack so that solving does not allocate, the capacity
+ * covers all roots of an octic and a couple of extra candidates pushed by the
+ * caller.
+ */
+struct Roots {
+  /// Max number of roots
+  static const int capacity = 10;
+  /// Roots
+  decimal_t t[capacity];
+  /// Number of roots
+  int n{0};
 
+  /// Append a root, ignored if the array is full
+  void push_back(decimal_t x) {
+    if (n < capacity)
+      t[n++] = x;
+  }
+  /// Remove all roots
+  void clear() { n = 0; }
+  /// Number of roots
+  int size() const { return n; }
+  /// Check if there is no root
+  bool empty() const { return n == 0; }
+  /// Access the i-th root
+  decimal_t operator[](int i) const { return t[i]; }
+  /// Begin iterator
+  const decimal_t *begin() const { return t; }
+  /// End iterator
+  const decimal_t *end() const { return t + n; }
+};
+
+/**
+ * @brief Quartic equation: \f$a*t^4+b*t^3+c*t^2+d*t+e = 0\f$
+ * @param ts output array with capacity of 4
+ *
+ * Write real roots into ts without allocation, return the number of roots
+ */
+inline int quartic(decimal_t a, decimal_t b, decimal_t c, decimal_t d,
+                   decimal_t e, decimal_t *ts) {
   decimal_t a3 = b / a;
   decimal_t a2 = c / a;
   decimal_t a1 = d / a;
   decimal_t a0 = e / a;
 
-  std::vector<decimal_t> ys = cubic(1, -a2, a1*a3-4*a0, 4*a2*a0-a1*a1-a3*a3*a0);
-  decimal_t y1 = ys.front();
-  //printf("y1: %f\n", y1);
+  decimal_t ys[3];
+  cubic(1, -a2, a1*a3-4*a0, 4*a2*a0-a1*a1-a3*a3*a0, ys);
+  decimal_t y1 = ys[0];
   decimal_t r = a3*a3/4-a2+y1;
-  //printf("r: %f\n", r);
 
-  //printf("a = %f, b = %f, c = %f, d = %f, e = %f\n", a, b, c, d, e);
   if(r < 0)
-    return dts;
+    return 0;
 
   decimal_t R = sqrt(r);
   decimal_t D, E;
@@ -98,16 +154,197 @@ inline std::vector<decimal_t> quartic(decimal_t a, decimal_t b, decimal_t c,
     E = sqrt(0.75*a3*a3-2*a2-2*sqrt(y1*y1-4*a0));
   }
 
+  int n = 0;
   if(!std::isnan(D)) {
-    dts.push_back(-a3/4+R/2+D/2);
-    dts.push_back(-a3/4+R/2-D/2);
+    ts[n++] = -a3/4+R/2+D/2;
+    ts[n++] = -a3/4+R/2-D/2;
   }
   if(!std::isnan(E)) {
-    dts.push_back(-a3/4-R/2+E/2);
-    dts.push_back(-a3/4-R/2-E/2);
+    ts[n++] = -a3/4-R/2+E/2;
+    ts[n++] = -a3/4-R/2-E/2;
+  }
+  return n;
+}
+
+/// Quartic equation: \f$a*t^4+b*t^3+c*t^2+d*t+e = 0\f$
+inline std::vector<decimal_t> quartic(decimal_t a, decimal_t b, decimal_t c,
+                                      decimal_t d, decimal_t e) {
+  decimal_t ts[4];
+  const int n = quartic(a, b, c, d, e, ts);
+  return std::vector<decimal_t>(ts, ts + n);
+}
+
+/// Evaluate the polynomial c of degree d at x, highest order first
+inline decimal_t polyval(const decimal_t *c, int d, decimal_t x) {
+  decimal_t v = c[0];
+  for (int i = 1; i <= d; i++)
+    v = v * x + c[i];
+  return v;
+}
+
+/// Return \f$\sum_i |c_i||x|^i\f$, the scale of rounding errors in `polyval()`
+inline decimal_t polyval_abs(const decimal_t *c, int d, decimal_t x) {
+  const decimal_t ax = std::abs(x);
+  decimal_t v = std::abs(c[0]);
+  for (int i = 1; i <= d; i++)
+    v = v * ax + std::abs(c[i]);
+  return v;
+}
+
+/**
+ * @brief Upper bound of the magnitude of roots of c (Fujiwara's bound)
+ *
+ * The result is strictly greater than the magnitude of every root, c[0] should
+ * not be zero
+ */
+inline decimal_t root_bound(const decimal_t *c, int d) {
+  decimal_t bound = 0;
+  for (int i = 1; i <= d; i++) {
+    const decimal_t ci = std::abs(c[i] / c[0]) / (i == d ? 2 : 1);
+    bound = std::max(bound, std::pow(ci, (decimal_t)1 / i));
   }
+  return 2 * bound * (1 + 1e-12) + std::numeric_limits<decimal_t>::min();
+}
 
-  return dts;
+/**
+ * @brief Root of c in \f$(a, b)\f$ given that \f$p(a)\f$ and \f$p(b)\f$ have opposite signs
+ * @param dc derivative of c
+ * @param fa \f$p(a)\f$
+ *
+ * Newton's method safeguarded by bisection: a Newton step is taken only if it
+ * stays inside the bracket and is less than half of the step before last
+ */
+inline decimal_t newton_bisect(const decimal_t *c, const decimal_t *dc, int d,
+                               decimal_t a, decimal_t b, decimal_t fa) {
+  const decimal_t eps = 1e-12;
+  decimal_t x = (a + b) / 2;
+  decimal_t dx = b - a, dx_old = dx;
+  for (int i = 0; i < 100; i++) {
+    const decimal_t f = polyval(c, d, x);
+    if (f == 0)
+      return x;
+    if ((f < 0) == (fa < 0))
+      a = x;
+    else
+      b = x;
+    const decimal_t df = polyval(dc, d - 1, x);
+    decimal_t x_new = df != 0 ? x - f / df : a;
+    if (!(x_new > a && x_new < b) || std::abs(x_new - x) > dx_old / 2)
+      x_new = (a + b) / 2;
+    dx_old = dx;
+    dx = std::abs(x_new - x);
+    if (dx <= eps * std::max<decimal_t>(1, std::abs(x)))
+      return x_new;
+    x = x_new;
+  }
+  return x;
+}
+
+/**
+ * @brief Real roots of polynomial c of degree d by bracketing, c[0] should not be zero
+ *
+ * Going up from the linear \f$(d-1)\f$-th derivative, the roots of each
+ * derivative split the root bound into pieces where the next one is
+ * monotone; a piece with a sign change holds exactly one root, which is found
+ * by `newton_bisect()`. A split point where the polynomial vanishes within
+ * rounding errors is a multiple root. The roots are in ascending order.
+ */
+inline void bracket_roots(const decimal_t *c, int d, Roots &roots) {
+  // q[j] is the (d-j)-th derivative of c, of degree j
+  decimal_t q[9][9];
+  for (int i = 0; i <= d; i++)
+    q[d][i] = c[i];
+  for (int j = d - 1; j >= 1; j--) {
+    for (int i = 0; i <= j; i++)
+      q[j][i] = q[j + 1][i] * (j + 1 - i);
+  }
+  const decimal_t hi = root_bound(c, d);
+  const decimal_t lo = -hi;
+
+  decimal_t x[9];
+  int n = 0;
+  const decimal_t r = -q[1][1] / q[1][0];
+  if (r > lo && r < hi)
+    x[n++] = r;
+  for (int j = 2; j <= d; j++) {
+    decimal_t y[9];
+    int m = 0;
+    decimal_t a = lo;
+    decimal_t fa = polyval(q[j], j, lo);
+    bool root_a = false;
+    for (int k = 0; k <= n; k++) {
+      const decimal_t b = k < n ? x[k] : hi;
+      const decimal_t fb = polyval(q[j], j, b);
+      const bool root_b =
+        k < n && std::abs(fb) <= 1e-12 * polyval_abs(q[j], j, b);
+      if (!root_a && !root_b && ((fa < 0 && fb > 0) || (fa > 0 && fb < 0)))
+        y[m++] = newton_bisect(q[j], q[j - 1], j, a, b, fa);
+      if (root_b)
+        y[m++] = b;
+      a = b;
+      fa = fb;
+      root_a = root_b;
+    }
+    for (int k = 0; k < m; k++)
+      x[k] = y[k];
+    n = m;
+  }
+  for (int k = 0; k < n; k++)
+    roots.push_back(x[k]);
+}
+
+/**
+ * @brief General solver for polynomial of degree up to 8 without allocation
+ * @param c coefficients, highest order first
+ * @param d degree, leading zero coefficients are skipped
+ * @param roots output real roots
+ *
+ * Degree 5 to 8 go through `bracket_roots()`, lower degrees use the closed
+ * form solutions above.
+ */
+inline void solve(const decimal_t *c, int d, Roots &roots) {
+  roots.clear();
+  while (d > 0 && c[0] == 0) {
+    c++;
+    d--;
+  }
+  if (d >= 5) {
+    bracket_roots(c, d, roots);
+    return;
+  }
+  decimal_t ts[4];
+  int n = 0;
+  if (d == 4)
+    n = quartic(c[0], c[1], c[2], c[3], c[4], ts);
+  else if (d == 3)
+    n = cubic(c[0], c[1], c[2], c[3], ts);
+  else if (d == 2)
+    n = quad(c[0], c[1], c[2], ts);
+  else if (d == 1)
+    ts[n++] = -c[1] / c[0];
+  for (int i = 0; i < n; i++)
+    roots.push_back(ts[i]);
+}
+
+/// General solver for \f$a*t^4+b*t^3+c*t^2+d*t+e = 0\f$ without allocation
+inline void solve(decimal_t a, decimal_t b, decimal_t c, decimal_t d,
+                  decimal_t e, Roots &roots) {
+  const decimal_t cs[5] = {a, b, c, d, e};
+  solve(cs, 4, roots);
+}
+
+/// General solver for \f$a*t^5+b*t^4+c*t^3+d*t^2+e*t+f = 0\f$ without allocation
+inline void solve(decimal_t a, decimal_t b, decimal_t c, decimal_t d,
+                  decimal_t e, decimal_t f, Roots &roots) {
+  const decimal_t cs[6] = {a, b, c, d, e, f};
+  solve(cs, 5, roots);
+}
+
+/// General solver for \f$a*t^6+b*t^5+c*t^4+d*t^3+e*t^2+f*t+g = 0\f$ without allocation
+inline void solve(decimal_t a, decimal_t b, decimal_t c, decimal_t d,
+                  decimal_t e, decimal_t f, decimal_t g, Roots &roots) {
+  const decimal_t cs[7] = {a, b, c, d, e, f, g};
+  solve(cs, 6, roots);
 }
 
 /*! \brief General solver for \f$a*t^4+b*t^3+c*t^2+d*t+e = 0\f$
@@ -117,71 +354,26 @@ inline std::vector<decimal_t> quartic(decimal_t a, decimal_t b, decimal_t c,
   */
 inline std::vector<decimal_t> solve(decimal_t a, decimal_t b, decimal_t c,
                                     decimal_t d, decimal_t e) {
-  std::vector<decimal_t> ts;
-  if (a != 0)
-    return quartic(a, b, c, d, e);
-  else if (b != 0)
-    return cubic(b, c, d, e);
-  else if (c != 0)
-    return quad(c, d, e);
-  else if (d != 0) {
-    ts.push_back(-e / d);
-    return ts;
-  } else
-    return ts;
+  Roots roots;
+  solve(a, b, c, d, e, roots);
+  return std::vector<decimal_t>(roots.begin(), roots.end());
 }
 
 /// General solver for \f$a*t^5+b*t^4+c*t^3+d*t^2+e*t+f = 0\f$
 inline std::vector<decimal_t> solve(decimal_t a, decimal_t b, decimal_t c,
                                     decimal_t d, decimal_t e, decimal_t f) {
-  std::vector<decimal_t> ts;
-  if (a == 0)
-    return solve(b, c, d, e, f);
-  else {
-    Eigen::VectorXd coeff(6);
-    coeff << f, e, d, c, b, a;
-    Eigen::PolynomialSolver<double, 5> solver;
-    solver.compute(coeff);
-
-    const Eigen::PolynomialSolver<double, 5>::RootsType &r = solver.roots();
-    std::vector<decimal_t> ts;
-    // std::cout << coeff.transpose() << std::endl;
-    for (int i = 0; i < r.rows(); ++i) {
-      if (r[i].imag() == 0) {
-        // std::cout << r[i] << std::endl;
-        ts.push_back(r[i].real());
-      }
-    }
-
-    return ts;
-  }
+  Roots roots;
+  solve(a, b, c, d, e, f, roots);
+  return std::vector<decimal_t>(roots.begin(), roots.end());
 }
 
 /// General solver for \f$a*t^6+b*t^5+c*t^4+d*t^3+e*t^2+f*t+g = 0\f$
 inline std::vector<decimal_t> solve(decimal_t a, decimal_t b, decimal_t c,
                                     decimal_t d, decimal_t e, decimal_t f,
                                     decimal_t g) {
-  std::vector<decimal_t> ts;
-  if (a == 0 && b == 0)
-    return solve(c, d, e, f, g);
-  else {
-    Eigen::VectorXd coeff(7);
-    coeff << g, f, e, d, c, b, a;
-    Eigen::PolynomialSolver<double, 6> solver;
-    solver.compute(coeff);
-
-    const Eigen::PolynomialSolver<double, 6>::RootsType &r = solver.roots();
-    std::vector<decimal_t> ts;
-    // std::cout << coeff.transpose() << std::endl;
-    for (int i = 0; i < r.rows(); ++i) {
-      if (r[i].imag() == 0) {
-        // std::cout << r[i] << std::endl;
-        ts.push_back(r[i].real());
-      }
-    }
-
-    return ts;
-  }
+  Roots roots;
+  solve(a, b, c, d, e, f, g, roots);
+  return std::vector<decimal_t>(roots.begin(), roots.end());
 }
 
 ///Return \f$n!\f$
@@ -144,6 +144,30 @@ class Primitive1D {
     return c(0) / 2 * t * t + c(1) * t + c(2);
   }
 
+  /**
+   * @brief Evaluate \f$p\f$ and its derivatives up to the n-th order at time \f$t\f$
+   * @param n highest order of derivative, from 0 (\f$p\f$ only) to 3 (up to \f$j\f$)
+   * @param d output array of size n+1, d[i] is the i-th derivative
+   *
+   * Each derivative is computed in nested (Horner) form, the chains are
+   * independent so that they can be evaluated in parallel
+   */
+  void evaluate(decimal_t t, int n, decimal_t *d) const {
+    switch (n) {
+      case 3:
+        d[3] = (c(0) / 2 * t + c(1)) * t + c(2);
+        // fall through
+      case 2:
+        d[2] = ((c(0) / 6 * t + c(1) / 2) * t + c(2)) * t + c(3);
+        // fall through
+      case 1:
+        d[1] = (((c(0) / 24 * t + c(1) / 6) * t + c(2) / 2) * t + c(3)) * t + c(4);
+        // fall through
+      default:
+        d[0] = ((((c(0) / 120 * t + c(1) / 24) * t + c(2) / 6) * t + c(3) / 2) * t + c(4)) * t + c(5);
+    }
+  }
+
   /**
    * @brief Return vector of time \f$t\f$ for velocity extrema
    *
@@ -186,13 +210,117 @@ class Primitive1D {
   std::vector<decimal_t> extrema_j(decimal_t t) const {
     std::vector<decimal_t> ts;
     if (c(0) != 0) {
-      decimal_t t = -c(1) * 2 / c(0);
-      if (t > 0 && t < t)
-        ts.push_back(t);
+      decimal_t tj = -c(1) / c(0);
+      if (tj > 0 && tj < t)
+        ts.push_back(tj);
     }
     return ts;
   }
 
+  /**
+   * @brief Return max \f$|v|\f$ over \f$[0, t]\f$
+   *
+   * Same as comparing both ends with the roots from `extrema_v()`, but the
+   * roots are kept in a fixed-size buffer so that no allocation happens
+   */
+  decimal_t max_v(decimal_t t) const {
+    decimal_t ts[3];
+    int n = 0;
+    if (c(0) / 6 != 0)
+      n = cubic(c(0) / 6, c(1) / 2, c(2), c(3), ts);
+    else if (c(1) / 2 != 0)
+      n = quad(c(1) / 2, c(2), c(3), ts);
+    else if (c(2) != 0)
+      ts[n++] = -c(3) / c(2);
+    decimal_t max_v = std::max(std::abs(v(0)), std::abs(v(t)));
+    for (int i = 0; i < n; i++) {
+      if (ts[i] > 0 && ts[i] < t) {
+        decimal_t vi = std::abs(v(ts[i]));
+        max_v = vi > max_v ? vi : max_v;
+      }
+      else if (ts[i] >= t)
+        break;
+    }
+    return max_v;
+  }
+
+  /**
+   * @brief Return max \f$|a|\f$ over \f$[0, t]\f$
+   *
+   * Same as comparing both ends with the roots from `extrema_a()` without
+   * allocation
+   */
+  decimal_t max_a(decimal_t t) const {
+    decimal_t ts[2];
+    int n = 0;
+    if (c(0) / 2 != 0)
+      n = quad(c(0) / 2, c(1), c(2), ts);
+    else if (c(1) != 0)
+      ts[n++] = -c(2) / c(1);
+    decimal_t max_a = std::max(std::abs(a(0)), std::abs(a(t)));
+    for (int i = 0; i < n; i++) {
+      if (ts[i] > 0 && ts[i] < t) {
+        decimal_t ai = std::abs(a(ts[i]));
+        max_a = ai > max_a ? ai : max_a;
+      }
+      else if (ts[i] >= t)
+        break;
+    }
+    return max_a;
+  }
+
+  /**
+   * @brief Return max \f$|j|\f$ over \f$[0, t]\f$
+   *
+   * Same as comparing both ends with the root from `extrema_j()` without
+   * allocation
+   */
+  decimal_t max_j(decimal_t t) const {
+    decimal_t max_j = std::max(std::abs(j(0)), std::abs(j(t)));
+    if (c(0) != 0) {
+      decimal_t tj = -c(1) / c(0);
+      if (tj > 0 && tj < t) {
+        decimal_t ji = std::abs(j(tj));
+        max_j = ji > max_j ? ji : max_j;
+      }
+    }
+    return max_j;
+  }
+
+  /**
+   * @brief Return conservative bounds \f$[p_{min}, p_{max}]\f$ of \f$p\f$ over \f$[t_1, t_2]\f$
+   *
+   * The polynomial is re-parameterized on \f$[t_1, t_2]\f$ and converted to the
+   * Bernstein basis, the curve lies in the convex hull of the control points,
+   * and the bounds are tight at both ends
+   */
+  Vec2f bound(decimal_t t1, decimal_t t2) const {
+    const decimal_t h = t2 - t1;
+    // Taylor coefficients at t1 scaled by h
+    const decimal_t a0 = p(t1);
+    const decimal_t a1 = v(t1) * h;
+    const decimal_t a2 = a(t1) / 2 * h * h;
+    const decimal_t a3 = j(t1) / 6 * power(h, 3);
+    const decimal_t a4 = (c(0) * t1 + c(1)) / 24 * power(h, 4);
+    const decimal_t a5 = c(0) / 120 * power(h, 5);
+    // Bernstein control points of degree 5
+    decimal_t b[6];
+    b[0] = a0;
+    b[1] = a0 + a1 / 5;
+    b[2] = a0 + a1 * 2 / 5 + a2 / 10;
+    b[3] = a0 + a1 * 3 / 5 + a2 * 3 / 10 + a3 / 10;
+    b[4] = a0 + a1 * 4 / 5 + a2 * 6 / 10 + a3 * 4 / 10 + a4 / 5;
+    b[5] = a0 + a1 + a2 + a3 + a4 + a5;
+    Vec2f bd(b[0], b[0]);
+    for (int i = 1; i < 6; i++) {
+      if (b[i] < bd(0))
+        bd(0) = b[i];
+      else if (b[i] > bd(1))
+        bd(1) = b[i];
+    }
+    return bd;
+  }
+
  public:
   /// Coefficients
   Vec6f c{Vec6f::Zero()};
@@ -327,21 +455,54 @@ class Primitive {
    */
   Waypoint<Dim> evaluate(decimal_t t) const {
     Waypoint<Dim> p(control_);
+    const int n = p.use_jrk ? 3 : p.use_acc ? 2 : p.use_vel ? 1 : 0;
+    decimal_t d[4] = {0, 0, 0, 0};
     for (int k = 0; k < Dim; k++) {
+      prs_[k].evaluate(t, n, d);
       if(p.use_pos)
-        p.pos(k) = prs_[k].p(t);
+        p.pos(k) = d[0];
       if(p.use_vel)
-        p.vel(k) = prs_[k].v(t);
+        p.vel(k) = d[1];
       if(p.use_acc)
-        p.acc(k) = prs_[k].a(t);
+        p.acc(k) = d[2];
       if(p.use_jrk)
-        p.jrk(k) = prs_[k].j(t);
-      if(p.use_yaw)
-        p.yaw = normalize_angle(pr_yaw_.p(t));
+        p.jrk(k) = d[3];
     }
+    if(p.use_yaw)
+      p.yaw = evaluate_yaw(t);
     return p;
   }
 
+  /**
+   * @brief Return position at time \f$t\f$
+   *
+   * Cheaper than `evaluate()` when only the position is needed
+   */
+  Vecf<Dim> evaluate_pos(decimal_t t) const {
+    Vecf<Dim> pos;
+    for (int k = 0; k < Dim; k++)
+      prs_[k].evaluate(t, 0, &pos(k));
+    return pos;
+  }
+
+  /// Return velocity at time \f$t\f$, also valid if the waypoints do not use vel
+  Vecf<Dim> evaluate_vel(decimal_t t) const {
+    Vecf<Dim> vel;
+    decimal_t d[2];
+    for (int k = 0; k < Dim; k++) {
+      prs_[k].evaluate(t, 1, d);
+      vel(k) = d[1];
+    }
+    return vel;
+  }
+
+  /// Return yaw at time \f$t\f$, valid only if the control uses yaw
+  decimal_t evaluate_yaw(decimal_t t) const {
+    decimal_t yaw;
+    pr_yaw_.evaluate(t, 0, &yaw);
+    return normalize_angle(yaw);
+  }
+
   /**
    * @brief Return duration \f$t\f$
    */
@@ -363,16 +524,7 @@ class Primitive {
    * @param k indicates the corresponding axis: 0-x, 1-y, 2-z
    */
   decimal_t max_vel(int k) const {
-    std::vector<decimal_t> ts = prs_[k].extrema_v(t_);
-    decimal_t max_v = std::max(std::abs(prs_[k].v(0)),
-                               std::abs(prs_[k].v(t_)));
-    for (const auto &it : ts) {
-      if (it > 0 && it < t_) {
-        decimal_t v = std::abs(prs_[k].v(it));
-        max_v = v > max_v ? v : max_v;
-      }
-    }
-    return max_v;
+    return prs_[k].max_v(t_);
   }
 
   /**
@@ -380,32 +532,30 @@ class Primitive {
    * @param k indicates the corresponding axis: 0-x, 1-y, 2-z
    */
   decimal_t max_acc(int k) const {
-    std::vector<decimal_t> ts = prs_[k].extrema_a(t_);
-    decimal_t max_a = std::max(std::abs(prs_[k].a(0)),
-                               std::abs(prs_[k].a(t_)));
-    for (const auto &it : ts) {
-      if (it > 0 && it < t_) {
-        decimal_t a = std::abs(prs_[k].a(it));
-        max_a = a > max_a ? a : max_a;
-      }
-    }
-    return max_a;
+    return prs_[k].max_a(t_);
   }
 
   /**
    * @brief Return max jerk along k-th dimension
    */
   decimal_t max_jrk(int k) const {
-    std::vector<decimal_t> ts = prs_[k].extrema_j(t_);
-    decimal_t max_j = std::max(std::abs(prs_[k].j(0)),
-                               std::abs(prs_[k].j(t_)));
-    for (const auto &it : ts) {
-      if (it > 0 && it < t_) {
-        decimal_t j = std::abs(prs_[k].j(it));
-        max_j = j > max_j ? j : max_j;
-      }
+    return prs_[k].max_j(t_);
+  }
+
+
+  /**
+   * @brief Return the axis-aligned bounding box of the primitive over \f$[t_1, t_2]\f$
+   * @param lo lower corner of the box
+   * @param hi upper corner of the box
+   *
+   * The box is conservative, see `Primitive1D::bound()`
+   */
+  void bound(decimal_t t1, decimal_t t2, Vecf<Dim> &lo, Vecf<Dim> &hi) const {
+    for (int k = 0; k < Dim; k++) {
+      const Vec2f bd = prs_[k].bound(t1, t2);
+      lo(k) = bd(0);
+      hi(k) = bd(1);
     }
-    return max_j;
   }
 
   /**
@@ -438,6 +588,19 @@ class Primitive {
     return ps;
   }
 
+  /**
+   * @brief Sample N+1 positions using uniformed time
+   * @param ps the buffer to write, it is resized only if its size is not N+1
+   *
+   * Reuse the same buffer across calls so that no allocation happens
+   */
+  void samplePositions(int N, vec_Vecf<Dim> &ps) const {
+    ps.resize(N+1);
+    decimal_t dt = t_ / N;
+    for (int i = 0; i <= N; i++)
+      ps[i] = evaluate_pos(i * dt);
+  }
+
   /************************** Public members ************************/
   ///Duration
   decimal_t t_;
@@ -525,12 +688,14 @@ bool validate_yaw(const Primitive<Dim>& pr, decimal_t my) {
   if (my <= 0)
     return true;
   // check velocity angle at two ends, compare with my
-  const auto ws = pr.sample(1);
-  for(const auto& w: ws) {
-    const auto v = w.vel.template topRows<2>();
+  // the velocity is evaluated as the waypoints of VEL control do not carry it
+  const decimal_t ts[2] = {0, pr.t()};
+  for(const auto& t: ts) {
+    const Vecf<Dim> vel = pr.evaluate_vel(t);
+    const auto v = vel.template topRows<2>();
     if(v.norm() > 1e-5) { // if v is not zero
       decimal_t vyaw = std::atan2(v(1), v(0));
-      decimal_t dyaw = normalize_angle(vyaw - w.yaw);
+      decimal_t dyaw = normalize_angle(vyaw - pr.evaluate_yaw(t));
       if(std::abs(dyaw) > my) // if exceed the threshold
         return false;
     }
@@ -0,0 +1,199 @@
+/**
+ * @file trace.h
+ * @brief scoped timeline events dumped in the Chrome trace format
+ *
+ * The events are compiled only if `MPL_TRACE` is defined (cmake option
+ * `MPL_TRACE`), otherwise `MPL_TRACE_SCOPE` expands to nothing. When compiled,
+ * the recording can be switched on and off at runtime with `Trace::enable()`.
+ * The file written by `Trace::write()` opens in Perfetto (ui.perfetto.dev) or
+ * chrome://tracing.
+ */
+#ifndef MPL_TRACE_H
+#define MPL_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MPL {
+
+/**
+ * @brief Recorder of the trace events
+ *
+ * Each thread owns a ring buffer of `capacity()` events. Recording only writes
+ * into the buffer of the calling thread and never locks; a buffer keeps the
+ * latest events once it is full. The registry of the buffers is locked when a
+ * thread records its first event, in `set_capacity()`/`capacity()` and in
+ * `write()`/`clear()`, the latter are meant to be called while no event is
+ * being recorded.
+ */
+class Trace {
+public:
+  /// A complete event, the name must outlive the trace (string literal)
+  struct Event {
+    const char *name;
+    int64_t start_ns;
+    int64_t dur_ns;
+  };
+
+  /// Switch the recording on or off, it is on by default
+  static void enable(bool on) { enabled_flag().store(on); }
+  /// Check if the recording is on
+  static bool enabled() {
+    return enabled_flag().load(std::memory_order_relaxed);
+  }
+  /// Number of events kept per thread, takes effect for new threads
+  static void set_capacity(size_t n) {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.capacity = std::max<size_t>(n, 1);
+  }
+  /// Number of events kept per thread
+  static size_t capacity() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return r.capacity;
+  }
+
+  /// Nanoseconds since the start of the trace
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - registry().origin)
+        .count();
+  }
+
+  /// Record an event into the buffer of the calling thread
+  static void record(const char *name, int64_t start_ns, int64_t dur_ns) {
+    Buffer &buffer = thread_buffer();
+    const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    Event &e = buffer.events[head % buffer.events.size()];
+    e.name = name;
+    e.start_ns = start_ns;
+    e.dur_ns = dur_ns;
+    buffer.head.store(head + 1, std::memory_order_release);
+  }
+
+  /// Drop all the recorded events
+  static void clear() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto &buffer : r.buffers)
+      buffer->head.store(0);
+  }
+
+  /// Number of events currently kept in all the buffers
+  static size_t size() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    size_t n = 0;
+    for (const auto &buffer : r.buffers)
+      n += std::min<uint64_t>(buffer->head.load(), buffer->events.size());
+    return n;
+  }
+
+  /// Write the events in the Chrome trace JSON format
+  static bool write(const std::string &file) {
+    FILE *f = fopen(file.c_str(), "w");
+    if (!f)
+      return false;
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (const auto &buffer : r.buffers) {
+      fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                 "\"tid\": %u, \"args\": {\"name\": \"mpl %u\"}}",
+              first ? "" : ",\n", buffer->tid, buffer->tid);
+      first = false;
+      const uint64_t head = buffer->head.load(std::memory_order_acquire);
+      const uint64_t n = std::min<uint64_t>(head, buffer->events.size());
+      for (uint64_t i = head - n; i < head; i++) {
+        const Event &e = buffer->events[i % buffer->events.size()];
+        fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"mpl\", \"ph\": \"X\", "
+                   "\"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                e.name, buffer->tid, e.start_ns * 1e-3, e.dur_ns * 1e-3);
+      }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+  }
+
+private:
+  /// Ring buffer of one thread
+  struct Buffer {
+    std::vector<Event> events;
+    std::atomic<uint64_t> head{0};
+    unsigned int tid = 0;
+  };
+
+  /// Buffers of all the threads, they outlive the threads
+  struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    size_t capacity = 1 << 16;
+    const std::chrono::steady_clock::time_point origin =
+        std::chrono::steady_clock::now();
+  };
+
+  static Registry &registry() {
+    static Registry r;
+    return r;
+  }
+
+  static std::atomic<bool> &enabled_flag() {
+    static std::atomic<bool> flag{true};
+    return flag;
+  }
+
+  static Buffer &thread_buffer() {
+    static thread_local std::shared_ptr<Buffer> buffer;
+    if (!buffer) {
+      Registry &r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      buffer = std::make_shared<Buffer>();
+      buffer->events.resize(r.capacity);
+      buffer->tid = r.buffers.size() + 1;
+      r.buffers.push_back(buffer);
+    }
+    return *buffer;
+  }
+};
+
+/// Record the lifetime of the scope as an event
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : name_(Trace::enabled() ? name : nullptr),
+        start_(name_ ? Trace::now() : 0) {}
+  ~TraceScope() {
+    if (name_)
+      Trace::record(name_, start_, Trace::now() - start_);
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *name_;
+  int64_t start_;
+};
+}
+
+#define MPL_TRACE_CAT_(a, b) a##b
+#define MPL_TRACE_CAT(a, b) MPL_TRACE_CAT_(a, b)
+
+#ifdef MPL_TRACE
+/// Record the rest of the current scope as an event named `name`
+#define MPL_TRACE_SCOPE(name)                                                  \
+  MPL::TraceScope MPL_TRACE_CAT(mpl_trace_scope_, __LINE__)(name)
+#else
+#define MPL_TRACE_SCOPE(name)
+#endif
+
+#endif
@@ -27,6 +27,61 @@ struct Command {
   decimal_t t;///Time \f$t\f$ wrt when evaluate
 };
 
+/**
+ * @brief Commands sampled along a trajectory, stored as structure of arrays
+ *
+ * Row \f$i\f$ of each matrix is the \f$i\f$-th sample and column \f$j\f$ is
+ * the \f$j\f$-th axis, so every channel of every axis is a contiguous array.
+ */
+template <int Dim>
+struct CommandArray {
+  /// Resize all channels to n samples, nothing is allocated if n is unchanged
+  void resize(int n) {
+    t.resize(n);
+    pos.resize(n, Dim);
+    vel.resize(n, Dim);
+    acc.resize(n, Dim);
+    jrk.resize(n, Dim);
+    yaw.resize(n);
+    yaw_dot.resize(n);
+  }
+
+  /// Number of samples
+  int size() const { return t.size(); }
+
+  /// Get the i-th sample as Command
+  Command<Dim> get(int i) const {
+    Command<Dim> p;
+    p.pos = pos.row(i).transpose();
+    p.vel = vel.row(i).transpose();
+    p.acc = acc.row(i).transpose();
+    p.jrk = jrk.row(i).transpose();
+    p.yaw = yaw(i);
+    p.yaw_dot = yaw_dot(i);
+    p.t = t(i);
+    return p;
+  }
+
+  /// Set the i-th sample from Command
+  void set(int i, const Command<Dim>& p) {
+    pos.row(i) = p.pos.transpose();
+    vel.row(i) = p.vel.transpose();
+    acc.row(i) = p.acc.transpose();
+    jrk.row(i) = p.jrk.transpose();
+    yaw(i) = p.yaw;
+    yaw_dot(i) = p.yaw_dot;
+    t(i) = p.t;
+  }
+
+  VecDf t; ///<time of each sample
+  Eigen::Matrix<decimal_t, Eigen::Dynamic, Dim> pos; ///<position, one column per axis
+  Eigen::Matrix<decimal_t, Eigen::Dynamic, Dim> vel; ///<velocity, one column per axis
+  Eigen::Matrix<decimal_t, Eigen::Dynamic, Dim> acc; ///<acceleration, one column per axis
+  Eigen::Matrix<decimal_t, Eigen::Dynamic, Dim> jrk; ///<jerk, one column per axis
+  VecDf yaw; ///<yaw
+  VecDf yaw_dot; ///<yaw velocity
+};
+
 /**
  * @brief Trajectory class
  *
@@ -54,47 +109,14 @@ class Trajectory {
      * @brief Evaluate Waypoint at time \f$t\f$
      *
      * If t is out of scope, we set t to be the closer bound (0 or total_t_) and return the evaluation;
-     * The failure case is when lambda is ill-posed such that \f$t = \lambda(\tau)^{-1}\f$ has no solution,
-     * in which a null Waypoint is returned
+     * The failure case is when the trajectory is empty, in which a null Waypoint is returned
      */
     Waypoint<Dim> evaluate(decimal_t time) const {
-      decimal_t tau = lambda_.getTau(time);
-      if (tau < 0)
-        tau = 0;
-      if (tau > total_t_)
-        tau = total_t_;
-
-      decimal_t lambda = 1;
-      decimal_t lambda_dot = 0;
-
-      if (lambda_.exist()) {
-        VirtualPoint vt = lambda_.evaluate(tau);
-        lambda = vt.p;
-        lambda_dot = vt.v;
-      }
-
-      for (int id = 0; id < (int)segs.size(); id++) {
-        if (tau >= taus[id] && tau <= taus[id + 1]) {
-          tau -= taus[id];
-          Waypoint<Dim> p(segs[id].control());
-          for (int j = 0; j < Dim; j++) {
-            const auto pr = segs[id].pr(j);
-            p.pos(j) = pr.p(tau);
-            p.vel(j) = pr.v(tau) / lambda;
-            p.acc(j) = pr.a(tau) / lambda / lambda -
-              p.vel(j) * lambda_dot / lambda / lambda / lambda;
-            p.jrk(j) = pr.j(tau) / lambda / lambda -
-              3 / power(lambda, 3) * p.acc(j) * p.acc(j) * lambda_dot +
-              3 / power(lambda, 4) * p.vel(j) * lambda_dot *
-              lambda_dot;
-            p.yaw = normalize_angle(segs[id].pr_yaw().p(tau));
-          }
-          return p;
-        }
-      }
-
-      printf("cannot find tau according to time: %f\n", time);
-      return Waypoint<Dim>();
+      Command<Dim> p;
+      const int id = evaluate(time, -1, p);
+      if (id < 0)
+        return Waypoint<Dim>();
+      return to_waypoint(p, segs[id].control());
     }
 
 
@@ -102,48 +124,48 @@ class Trajectory {
      * @brief Evaluate Command at \f$t\f$, return false if fails to evaluate
      *
      * If \f$t\f$ is out of scope, we set \f$t\f$ to be the closer bound (0 or total_t_) and return the evaluation;
-     * The failure case is when lambda is ill-posed such that \f$t = \lambda(\tau)^{-1}\f$ has no solution.
+     * The failure case is when the trajectory is empty.
      */
     bool evaluate(decimal_t time, Command<Dim>& p) const {
-      decimal_t tau = lambda_.getTau(time);
-      if (tau < 0)
-        tau = 0;
-      if (tau > total_t_)
-        tau = total_t_;
-
-      decimal_t lambda = 1;
-      decimal_t lambda_dot = 0;
+      return evaluate(time, -1, p) >= 0;
+    }
 
-      if (lambda_.exist()) {
-        VirtualPoint vt = lambda_.evaluate(tau);
-        lambda = vt.p;
-        lambda_dot = vt.v;
-      }
+    /**
+     * @brief Stateful evaluator for queries of increasing time
+     *
+     * The cursor keeps the segment of the last query and walks forward from
+     * it, so sampling the trajectory in time order costs amortized O(1) per
+     * query instead of a search. A query earlier than the last one falls back
+     * to binary search. The cursor refers to the trajectory, which must
+     * outlive it and stay unchanged.
+     */
+    class Cursor {
+      public:
+        /// Construct a cursor at the start of the trajectory
+        Cursor(const Trajectory<Dim>& traj) : traj_(&traj) {}
+
+        /// Evaluate Waypoint at time \f$t\f$, see Trajectory::evaluate
+        Waypoint<Dim> evaluate(decimal_t time) {
+          Command<Dim> p;
+          id_ = traj_->evaluate(time, id_, p);
+          if (id_ < 0)
+            return Waypoint<Dim>();
+          return traj_->to_waypoint(p, traj_->segs[id_].control());
+        }
 
-      for (int id = 0; id < (int)segs.size(); id++) {
-        if (tau >= taus[id] && tau <= taus[id + 1]) {
-          tau -= taus[id];
-          for (int j = 0; j < Dim; j++) {
-            const auto pr = segs[id].pr(j);
-            p.pos(j) = pr.p(tau);
-            p.vel(j) = pr.v(tau) / lambda;
-            p.acc(j) = pr.a(tau) / lambda / lambda -
-              p.vel(j) * lambda_dot / lambda / lambda / lambda;
-            p.jrk(j) = pr.j(tau) / lambda / lambda -
-              3 / power(lambda, 3) * p.acc(j) * p.acc(j) * lambda_dot +
-              3 / power(lambda, 4) * p.vel(j) * lambda_dot *
-              lambda_dot;
-            p.yaw = normalize_angle(segs[id].pr_yaw().p(tau));
-            p.yaw_dot = normalize_angle(segs[id].pr_yaw().v(tau));
-            p.t = time;
-          }
-          return true;
+        /// Evaluate Command at time \f$t\f$, see Trajectory::evaluate
+        bool evaluate(decimal_t time, Command<Dim>& p) {
+          id_ = traj_->evaluate(time, id_, p);
+          return id_ >= 0;
         }
-      }
 
-      printf("cannot find tau according to time: %f\n", time);
-      return false;
-    }
+      private:
+        const Trajectory<Dim>* traj_;
+        int id_ = -1;
+    };
+
+    /// Get a Cursor for evaluating at increasing time
+    Cursor cursor() const { return Cursor(*this); }
 
 
     /**
@@ -253,12 +275,65 @@ class Trajectory {
       vec_E<Command<Dim>> ps(N+1);
 
       decimal_t dt = total_t_ / N;
+      Cursor cursor(*this);
       for (int i = 0; i <= N; i++)
-        evaluate(i * dt, ps[i]);
+        cursor.evaluate(i * dt, ps[i]);
 
       return ps;
     }
 
+    /**
+     * @brief Sample N+1 Command along trajectory using uniformed time into SoA buffers
+     * @param cmds the buffer to write, it is resized only if its size is not N+1
+     */
+    void sample(int N, CommandArray<Dim>& cmds) const {
+      sample(0, total_t_ / N, N + 1, cmds);
+    }
+
+    /**
+     * @brief Sample n Command at time \f$t_0 + i\,dt\f$ into SoA buffers
+     * @param t0 time of the first sample
+     * @param dt non-negative time step
+     * @param n number of samples
+     * @param cmds the buffer to write, it is resized only if its size is not n
+     *
+     * Out of scope times are clamped as in evaluate. Without scaling, the samples
+     * of each segment are evaluated together in Horner form, channel by channel,
+     * with no segment search. A scaled trajectory is evaluated sample by sample
+     * with a Cursor.
+     */
+    void sample(decimal_t t0, decimal_t dt, int n, CommandArray<Dim>& cmds) const {
+      cmds.resize(n);
+      if (segs.empty())
+        return;
+
+      if (lambda_.exist()) {
+        Cursor cursor(*this);
+        Command<Dim> p;
+        for (int i = 0; i < n; i++) {
+          cursor.evaluate(t0 + i * dt, p);
+          cmds.set(i, p);
+        }
+        return;
+      }
+
+      const int num_seg = segs.size();
+      int i0 = 0;
+      for (int id = 0; id < num_seg && i0 < n; id++) {
+        // samples up to the end of this segment, the last one takes the rest
+        int i1 = i0;
+        if (id + 1 == num_seg)
+          i1 = n;
+        else {
+          while (i1 < n && std::min(std::max<decimal_t>(t0 + i1 * dt, 0), total_t_) <= taus[id + 1])
+            i1++;
+        }
+        if (i1 > i0)
+          sample_segment(id, t0, dt, i0, i1, cmds);
+        i0 = i1;
+      }
+    }
+
     /**
      * @brief Return total efforts of Primitive for the given duration: \f$J(i) = \int_0^T |p^{i}(t)|^2dt\f$
      * @param control Flag that indicates the order of derivative \f$i\f$
@@ -321,6 +396,113 @@ class Trajectory {
     /// Get the total duration of Trajectory
     decimal_t getTotalTime() const { return total_t_; }
 
+  private:
+    /**
+     * @brief Index of the first segment that ends at or after tau
+     *
+     * Walks forward from a valid hint, otherwise binary searches taus.
+     * Return -1 if there is no segment.
+     */
+    int locate(decimal_t tau, int hint) const {
+      const int n = segs.size();
+      if (hint < 0 || hint >= n || (hint > 0 && tau <= taus[hint])) {
+        const int id =
+          std::lower_bound(taus.begin() + 1, taus.end(), tau) - taus.begin() - 1;
+        return std::min(id, n - 1);
+      }
+      while (hint + 1 < n && tau > taus[hint + 1])
+        hint++;
+      return hint;
+    }
+
+    /// Evaluate Command at time \f$t\f$ searching from segment hint, return the segment index or -1 if fails
+    int evaluate(decimal_t time, int hint, Command<Dim>& p) const {
+      decimal_t tau = lambda_.getTau(time);
+      if (tau < 0)
+        tau = 0;
+      if (tau > total_t_)
+        tau = total_t_;
+
+      decimal_t lambda = 1;
+      decimal_t lambda_dot = 0;
+
+      if (lambda_.exist()) {
+        VirtualPoint vt = lambda_.evaluate(tau);
+        lambda = vt.p;
+        lambda_dot = vt.v;
+      }
+
+      const int id = locate(tau, hint);
+      if (id < 0) {
+        printf("cannot find tau according to time: %f\n", time);
+        return -1;
+      }
+
+      tau -= taus[id];
+      const auto& seg = segs[id];
+      for (int j = 0; j < Dim; j++) {
+        const auto pr = seg.pr(j);
+        p.pos(j) = pr.p(tau);
+        p.vel(j) = pr.v(tau) / lambda;
+        p.acc(j) = pr.a(tau) / lambda / lambda -
+          p.vel(j) * lambda_dot / lambda / lambda / lambda;
+        p.jrk(j) = pr.j(tau) / lambda / lambda -
+          3 / power(lambda, 3) * p.acc(j) * p.acc(j) * lambda_dot +
+          3 / power(lambda, 4) * p.vel(j) * lambda_dot *
+          lambda_dot;
+      }
+      const auto pr_yaw = seg.pr_yaw();
+      p.yaw = normalize_angle(pr_yaw.p(tau));
+      p.yaw_dot = normalize_angle(pr_yaw.v(tau));
+      p.t = time;
+      return id;
+    }
+
+    /// Evaluate samples i0 to i1 (exclusive) of an unscaled trajectory on segment id
+    void sample_segment(int id, decimal_t t0, decimal_t dt, int i0, int i1,
+                        CommandArray<Dim>& cmds) const {
+      const decimal_t ts = taus[id];
+      for (int i = i0; i < i1; i++)
+        cmds.t(i) = t0 + i * dt;
+      for (int j = 0; j < Dim; j++) {
+        const Vec6f c = segs[id].pr(j).coeff();
+        const decimal_t c0 = c(0), c1 = c(1), c2 = c(2), c3 = c(3), c4 = c(4), c5 = c(5);
+        const decimal_t* t = cmds.t.data();
+        decimal_t* pos = cmds.pos.col(j).data();
+        decimal_t* vel = cmds.vel.col(j).data();
+        decimal_t* acc = cmds.acc.col(j).data();
+        decimal_t* jrk = cmds.jrk.col(j).data();
+        for (int i = i0; i < i1; i++) {
+          const decimal_t tau = std::min(std::max<decimal_t>(t[i], 0), total_t_) - ts;
+          pos[i] = ((((c0 / 120 * tau + c1 / 24) * tau + c2 / 6) * tau + c3 / 2) * tau + c4) * tau + c5;
+          vel[i] = (((c0 / 24 * tau + c1 / 6) * tau + c2 / 2) * tau + c3) * tau + c4;
+          acc[i] = ((c0 / 6 * tau + c1 / 2) * tau + c2) * tau + c3;
+          jrk[i] = (c0 / 2 * tau + c1) * tau + c2;
+        }
+      }
+      const Vec6f c = segs[id].pr_yaw().coeff();
+      for (int i = i0; i < i1; i++) {
+        const decimal_t tau = std::min(std::max<decimal_t>(cmds.t(i), 0), total_t_) - ts;
+        cmds.yaw(i) = normalize_angle(
+          ((((c(0) / 120 * tau + c(1) / 24) * tau + c(2) / 6) * tau + c(3) / 2) * tau + c(4)) * tau + c(5));
+        cmds.yaw_dot(i) = normalize_angle(
+          (((c(0) / 24 * tau + c(1) / 6) * tau + c(2) / 2) * tau + c(3)) * tau + c(4));
+      }
+    }
+
+    /// Convert Command to Waypoint with the given control
+    static Waypoint<Dim> to_waypoint(const Command<Dim>& p,
+                                     Control::Control control) {
+      Waypoint<Dim> w(control);
+      w.pos = p.pos;
+      w.vel = p.vel;
+      w.acc = p.acc;
+      w.jrk = p.jrk;
+      w.yaw = p.yaw;
+      return w;
+    }
+
+  public:
     ///Segments of primitives
     vec_E<Primitive<Dim>> segs;
     ///Time in virtual domain
@@ -328,7 +510,7 @@ class Trajectory {
     ///Time in actual domain
     std::vector<decimal_t> Ts;
     ///Total time of the trajectory
-    decimal_t total_t_;
+    decimal_t total_t_{0};
     ///Scaling object
     Lambda lambda_;
 };
@@ -0,0 +1,378 @@
+/**
+ * @file map_generator.h
+ * @brief MapGenerator class
+ */
+#ifndef MPL_MAP_GENERATOR_H
+#define MPL_MAP_GENERATOR_H
+
+#include <mpl_collision/map_util.h>
+#include <memory>
+#include <queue>
+#include <random>
+
+namespace MPL {
+  /**
+   * @brief Procedural map generator for benchmarks and scaling studies
+   * @param Dim is the dimension of the workspace
+   *
+   * Maps cover the range from the origin at the given resolution, the same
+   * seed gives the same maps and queries. In 3D, the obstacles of the 2D
+   * patterns are extruded along the z-axis.
+   */
+  template <int Dim> class MapGenerator {
+    public:
+      /**
+       * @brief Simple constructor
+       * @param range size of the map in each axis
+       * @param res map resolution
+       * @param seed seed of the random number generator
+       */
+      MapGenerator(const Vecf<Dim> &range, decimal_t res, unsigned int seed = 0)
+        : res_(res), gen_(seed) {
+          for (int i = 0; i < Dim; i++)
+            dim_(i) = std::ceil(range(i) / res);
+        }
+
+      ///Get dimensions
+      Veci<Dim> getDim() const { return dim_; }
+      ///Get resolution
+      decimal_t getRes() const { return res_; }
+
+      /**
+       * @brief Random forest of cylinders
+       * @param density fraction of the area covered by cylinders
+       * @param r_min min radius of cylinders
+       * @param r_max max radius of cylinders
+       *
+       * Cylinders are discs in 2D and stand on the ground with full height in 3D.
+       * The density is clamped to [0, 1], and at most one cylinder per cell of
+       * the ground is placed, so a high density may end up slightly lower.
+       */
+      std::shared_ptr<MapUtil<Dim>> forest(decimal_t density, decimal_t r_min,
+                                           decimal_t r_max) {
+        Tmap map = empty();
+        std::uniform_real_distribution<decimal_t> ur(r_min, r_max);
+        const int area = dim_(0) * dim_(1);
+        density = std::max<decimal_t>(0, std::min<decimal_t>(1, density));
+        int covered = 0;
+        for (int n = 0; n < area && covered < density * area; n++) {
+          const Vec2f c = random_point();
+          const decimal_t r = ur(gen_);
+          covered += fill_disc(map, c, r);
+        }
+        return make_map(map);
+      }
+
+      /**
+       * @brief Perfect maze
+       * @param cell size of each maze cell, the corridor is the cell minus the wall
+       * @param wall thickness of walls
+       *
+       * The maze is carved by a randomized depth-first search, so any two cells
+       * are connected by exactly one path.
+       */
+      std::shared_ptr<MapUtil<Dim>> maze(decimal_t cell, decimal_t wall) {
+        Tmap map = empty();
+        const int nx = std::max(1, (int) (dim_(0) * res_ / cell));
+        const int ny = std::max(1, (int) (dim_(1) * res_ / cell));
+        // open walls on the right (bit 0) and the top (bit 1) of each cell
+        std::vector<int> open(nx * ny, 0);
+        std::vector<bool> visited(nx * ny, false);
+        std::vector<int> stack(1, 0);
+        visited[0] = true;
+        while (!stack.empty()) {
+          const int id = stack.back();
+          const int x = id % nx, y = id / nx;
+          std::vector<int> ns;
+          if (x > 0 && !visited[id - 1]) ns.push_back(id - 1);
+          if (x + 1 < nx && !visited[id + 1]) ns.push_back(id + 1);
+          if (y > 0 && !visited[id - nx]) ns.push_back(id - nx);
+          if (y + 1 < ny && !visited[id + nx]) ns.push_back(id + nx);
+          if (ns.empty()) {
+            stack.pop_back();
+            continue;
+          }
+          const int next = ns[gen_() % ns.size()];
+          if (next == id + 1) open[id] |= 1;
+          else if (next == id - 1) open[next] |= 1;
+          else if (next == id + nx) open[id] |= 2;
+          else open[next] |= 2;
+          visited[next] = true;
+          stack.push_back(next);
+        }
+
+        const decimal_t h = wall / 2;
+        for (int y = 0; y < ny; y++) {
+          for (int x = 0; x < nx; x++) {
+            const decimal_t x1 = (x + 1) * cell, y1 = (y + 1) * cell;
+            if (!(open[x + y * nx] & 1))
+              fill_box(map, Vec2f(x1 - h, y * cell - h), Vec2f(x1 + h, y1 + h));
+            if (!(open[x + y * nx] & 2))
+              fill_box(map, Vec2f(x * cell - h, y1 - h), Vec2f(x1 + h, y1 + h));
+          }
+        }
+        // outer walls
+        fill_box(map, Vec2f(-h, -h), Vec2f(nx * cell + h, h));
+        fill_box(map, Vec2f(-h, -h), Vec2f(h, ny * cell + h));
+        return make_map(map);
+      }
+
+      /**
+       * @brief Urban blocks of buildings
+       * @param block size of each block
+       * @param street width of streets between blocks
+       * @param h_min min height of buildings, only used in 3D
+       * @param h_max max height of buildings, only used in 3D
+       *
+       * About one of five blocks is left empty as a square, the others hold
+       * one building with a random setback from the street.
+       */
+      std::shared_ptr<MapUtil<Dim>> urban(decimal_t block, decimal_t street,
+                                          decimal_t h_min = 0,
+                                          decimal_t h_max = 0) {
+        Tmap map = empty();
+        std::uniform_real_distribution<decimal_t> u(0, 1);
+        const decimal_t pitch = block + street;
+        for (decimal_t x = street; x + block <= dim_(0) * res_; x += pitch) {
+          for (decimal_t y = street; y + block <= dim_(1) * res_; y += pitch) {
+            if (u(gen_) < 0.2)
+              continue;
+            const decimal_t setback = 0.2 * block * u(gen_);
+            const decimal_t height = h_min + (h_max - h_min) * u(gen_);
+            fill_box(map, Vec2f(x + setback, y + setback),
+                     Vec2f(x + block - setback, y + block - setback),
+                     Dim == 3 ? height : -1);
+          }
+        }
+        return make_map(map);
+      }
+
+      /**
+       * @brief Walls across the x-axis with one narrow gap each
+       * @param num_walls number of walls, evenly spaced
+       * @param gap width of the gap, the gap is a square hole in 3D
+       * @param thickness thickness of walls
+       */
+      std::shared_ptr<MapUtil<Dim>> narrowGap(int num_walls, decimal_t gap,
+                                              decimal_t thickness) {
+        Tmap map = empty();
+        std::uniform_real_distribution<decimal_t> u(0, 1);
+        const Vecf<Dim> range = dim_.template cast<decimal_t>() * res_;
+        for (int k = 1; k <= num_walls; k++) {
+          const decimal_t x = range(0) * k / (num_walls + 1);
+          Vecf<Dim> lo = Vecf<Dim>::Zero(), hi = range;
+          lo(0) = x - thickness / 2;
+          hi(0) = x + thickness / 2;
+          // the hole in the wall
+          Vecf<Dim> gap_lo = lo, gap_hi = hi;
+          for (int i = 1; i < Dim; i++) {
+            gap_lo(i) = (range(i) - gap) * u(gen_);
+            gap_hi(i) = gap_lo(i) + gap;
+          }
+          const Veci<Dim> n1 = to_cell(lo), n2 = to_cell(hi);
+          const Veci<Dim> g1 = to_cell(gap_lo), g2 = to_cell(gap_hi);
+          for_each_cell(n1, n2, [&](const Veci<Dim> &pn) {
+              bool in_gap = true;
+              for (int i = 1; i < Dim; i++)
+                in_gap &= pn(i) >= g1(i) && pn(i) < g2(i);
+              if (!in_gap)
+                map[index(pn)] = 100;
+            });
+        }
+        return make_map(map);
+      }
+
+      /**
+       * @brief Sample start and goal pairs in the same free component
+       * @param map_util the map
+       * @param num number of pairs
+       * @param radius min distance from start and goal to obstacles
+       * @param min_dist min distance between start and goal
+       *
+       * Start and goal are cell centers whose clearance is larger than the
+       * radius, they are connected through such cells by the 2*Dim-neighbors.
+       * Fewer pairs are returned if they cannot be found.
+       */
+      vec_E<std::pair<Vecf<Dim>, Vecf<Dim>>> startGoal(
+          const MapUtil<Dim> &map_util, int num, decimal_t radius,
+          decimal_t min_dist) {
+        MapUtil<Dim> util = map_util;
+        util.updateClearance();
+        const Veci<Dim> dim = util.getDim();
+        int size = 1;
+        for (int i = 0; i < Dim; i++)
+          size *= dim(i);
+
+        // label components of the safe cells
+        std::vector<int> label(size, -1);
+        std::vector<int> safe;
+        Veci<Dim> pn;
+        for (int idx = 0; idx < size; idx++) {
+          if (label[idx] != -1 || !is_safe(util, idx, radius))
+            continue;
+          std::queue<int> q;
+          q.push(idx);
+          label[idx] = idx;
+          while (!q.empty()) {
+            const int id = q.front();
+            q.pop();
+            safe.push_back(id);
+            pn = to_coord(id, dim);
+            for (int i = 0; i < Dim; i++) {
+              for (int d : {-1, 1}) {
+                Veci<Dim> nn = pn;
+                nn(i) += d;
+                if (util.isOutside(nn))
+                  continue;
+                const int nid = util.getIndex(nn);
+                if (label[nid] == -1 && is_safe(util, nid, radius)) {
+                  label[nid] = idx;
+                  q.push(nid);
+                }
+              }
+            }
+          }
+        }
+
+        vec_E<std::pair<Vecf<Dim>, Vecf<Dim>>> pairs;
+        if (safe.empty())
+          return pairs;
+        for (int k = 0; k < 100 * num && (int) pairs.size() < num; k++) {
+          const int s = safe[gen_() % safe.size()];
+          const int g = safe[gen_() % safe.size()];
+          if (label[s] != label[g])
+            continue;
+          const Vecf<Dim> start = util.intToFloat(to_coord(s, dim));
+          const Vecf<Dim> goal = util.intToFloat(to_coord(g, dim));
+          if ((start - goal).norm() >= min_dist)
+            pairs.push_back(std::make_pair(start, goal));
+        }
+        return pairs;
+      }
+
+    protected:
+      ///Map of free cells
+      Tmap empty() const {
+        int size = 1;
+        for (int i = 0; i < Dim; i++)
+          size *= dim_(i);
+        return Tmap(size, 0);
+      }
+
+      ///Create map util from map data
+      std::shared_ptr<MapUtil<Dim>> make_map(const Tmap &map) const {
+        std::shared_ptr<MapUtil<Dim>> map_util(new MapUtil<Dim>);
+        map_util->setMap(Vecf<Dim>::Zero(), dim_, map, res_);
+        return map_util;
+      }
+
+      ///Uniform random point in the xy-plane of the map
+      Vec2f random_point() {
+        std::uniform_real_distribution<decimal_t> u(0, 1);
+        return Vec2f(u(gen_) * dim_(0) * res_, u(gen_) * dim_(1) * res_);
+      }
+
+      ///Cell that contains the point, not clamped
+      Veci<Dim> to_cell(const Vecf<Dim> &pt) const {
+        Veci<Dim> pn;
+        for (int i = 0; i < Dim; i++)
+          pn(i) = std::floor(pt(i) / res_);
+        return pn;
+      }
+
+      ///Coordinate of the cell index in a map of the given dimensions
+      static Veci<Dim> to_coord(int idx, const Veci<Dim> &dim) {
+        Veci<Dim> pn;
+        for (int i = 0; i < Dim; i++) {
+          pn(i) = idx % dim(i);
+          idx /= dim(i);
+        }
+        return pn;
+      }
+
+      ///Index of the cell
+      int index(const Veci<Dim> &pn) const {
+        int idx = 0, stride = 1;
+        for (int i = 0; i < Dim; i++) {
+          idx += pn(i) * stride;
+          stride *= dim_(i);
+        }
+        return idx;
+      }
+
+      ///Call f on each cell in the box [n1, n2), clamped to the map
+      template <typename F>
+      void for_each_cell(Veci<Dim> n1, Veci<Dim> n2, const F &f) const {
+        int num = 1;
+        for (int i = 0; i < Dim; i++) {
+          n1(i) = std::max(n1(i), 0);
+          n2(i) = std::min(n2(i), dim_(i));
+          if (n2(i) <= n1(i))
+            return;
+          num *= n2(i) - n1(i);
+        }
+        Veci<Dim> pn;
+        for (int k = 0; k < num; k++) {
+          int r = k;
+          for (int i = 0; i < Dim; i++) {
+            pn(i) = n1(i) + r % (n2(i) - n1(i));
+            r /= n2(i) - n1(i);
+          }
+          f(pn);
+        }
+      }
+
+      /**
+       * @brief Fill the box in the xy-plane
+       * @param height height of the box in 3D, negative means the full height
+       */
+      void fill_box(Tmap &map, const Vec2f &lo, const Vec2f &hi,
+                    decimal_t height = -1) const {
+        Vecf<Dim> lo_d = Vecf<Dim>::Zero(), hi_d = dim_.template cast<decimal_t>() * res_;
+        lo_d.template topRows<2>() = lo;
+        hi_d.template topRows<2>() = hi;
+        if (Dim == 3 && height >= 0)
+          hi_d(Dim - 1) = height;
+        for_each_cell(to_cell(lo_d), to_cell(hi_d) + Veci<Dim>::Ones(),
+                      [&](const Veci<Dim> &pn) { map[index(pn)] = 100; });
+      }
+
+      ///Fill the disc in the xy-plane with full height, return the number of new occupied columns
+      int fill_disc(Tmap &map, const Vec2f &c, decimal_t r) const {
+        int num = 0;
+        Vecf<Dim> lo = Vecf<Dim>::Zero(), hi = dim_.template cast<decimal_t>() * res_;
+        lo.template topRows<2>() = c - Vec2f::Constant(r);
+        hi.template topRows<2>() = c + Vec2f::Constant(r);
+        for_each_cell(to_cell(lo), to_cell(hi) + Veci<Dim>::Ones(),
+                      [&](const Veci<Dim> &pn) {
+            const Vec2f p = (pn.template topRows<2>().template cast<decimal_t>() +
+                             Vec2f::Constant(0.5)) * res_;
+            if ((p - c).norm() > r)
+              return;
+            int8_t &v = map[index(pn)];
+            if (v != 100 && (Dim == 2 || pn(Dim - 1) == 0))
+              num++;
+            v = 100;
+          });
+        return num;
+      }
+
+      ///Check if the cell is free and farther than the radius from obstacles
+      static bool is_safe(const MapUtil<Dim> &util, int idx, decimal_t radius) {
+        return !util.isOccupied(idx, radius);
+      }
+
+      ///Dimension
+      Veci<Dim> dim_;
+      ///Resolution
+      decimal_t res_;
+      ///Random number generator
+      std::mt19937 gen_;
+  };
+
+  typedef MapGenerator<2> OccMapGenerator;
+
+  typedef MapGenerator<3> VoxelMapGenerator;
+}
+
+#endif
@@ -7,75 +7,125 @@
 
 #include <mpl_basis/data_type.h>
 #include <iostream>
+#include <limits>
+#include <cmath>
 
 namespace MPL {
   ///The type of map data Tmap is defined as a 1D array
   using Tmap = std::vector<signed char>;
+  /**
+   * @brief The type of clearance data is defined as a 1D array
+   *
+   * Each cell stores the squared distance (in cells) to the nearest occupied
+   * cell, saturated at the max value of uint16_t
+   */
+  using Tclearance = std::vector<uint16_t>;
   /**
    * @biref The map util class for collision checking
    * @param Dim is the dimension of the workspace
+   *
+   * The const members only read the map, so a map that is no longer modified
+   * can be shared by planners running on different threads without locks.
    */
   template <int Dim> class MapUtil {
     public:
       ///Simple constructor
       MapUtil() {}
       ///Get map data
-      Tmap getMap() { return map_; }
+      const Tmap &getMap() const { return map_; }
       ///Get resolution
-      decimal_t getRes() { return res_; }
+      decimal_t getRes() const { return res_; }
       ///Get dimensions
-      Veci<Dim> getDim() { return dim_; }
+      Veci<Dim> getDim() const { return dim_; }
       ///Get origin
-      Vecf<Dim> getOrigin() { return origin_d_; }
+      Vecf<Dim> getOrigin() const { return origin_d_; }
       ///Get index of a cell for 2D
       template<int U = Dim>
         typename std::enable_if<U == 2, int>::type
-        getIndex(const Veci<Dim>& pn) {
+        getIndex(const Veci<Dim>& pn) const {
           return pn(0) + dim_(0) * pn(1);
         }
       ///Get index of a cell for 3D
       template<int U = Dim>
         typename std::enable_if<U == 3, int>::type
-        getIndex(const Veci<Dim>& pn) {
+        getIndex(const Veci<Dim>& pn) const {
           return pn(0) + dim_(0) * pn(1) + dim_(0) * dim_(1) * pn(2);
         }
 
 
       ///Check if the cell is free by index
-      bool isFree(int idx) { return map_[idx] < val_occ && map_[idx] >= val_free; }
+      bool isFree(int idx) const { return map_[idx] < val_occ && map_[idx] >= val_free; }
       ///Check if the cell is unknown by index
-      bool isUnknown(int idx) { return map_[idx] == val_unknown; }
+      bool isUnknown(int idx) const { return map_[idx] == val_unknown; }
       ///Check if the cell is occupied by index
-      bool isOccupied(int idx) { return map_[idx] == val_occ; }
+      bool isOccupied(int idx) const { return map_[idx] == val_occ; }
 
       ///Check if the cell is outside by coordinate
-      bool isOutside(const Veci<Dim> &pn) {
+      bool isOutside(const Veci<Dim> &pn) const {
         for(int i = 0; i < Dim; i++)
           if (pn(i) < 0 || pn(i) >= dim_(i))
             return true;
         return false;
       }
       ///Check if the given cell is free by coordinate
-      bool isFree(const Veci<Dim> &pn) {
+      bool isFree(const Veci<Dim> &pn) const {
         if (isOutside(pn))
           return false;
         else
           return isFree(getIndex(pn));
       }
       ///Check if the given cell is occupied by coordinate
-      bool isOccupied(const Veci<Dim> &pn) {
+      bool isOccupied(const Veci<Dim> &pn) const {
         if (isOutside(pn))
           return false;
         else
           return isOccupied(getIndex(pn));
       }
       ///Check if the given cell is unknown by coordinate
-      bool isUnknown(const Veci<Dim> &pn) {
+      bool isUnknown(const Veci<Dim> &pn) const {
         if (isOutside(pn))
           return false;
         return isUnknown(getIndex(pn));
       }
 
+      ///Check if the clearance layer has been computed
+      bool hasClearance() const { return !clearance_.empty(); }
+      ///Get the clearance of a cell by index, return the distance to the nearest occupied cell
+      decimal_t getClearance(int idx) const {
+        return std::sqrt((decimal_t) clearance_[idx]) * res_;
+      }
+      ///Get the clearance of a cell by coordinate, return zero if the cell is outside
+      decimal_t getClearance(const Veci<Dim> &pn) const {
+        if (isOutside(pn) || clearance_.empty())
+          return 0;
+        return getClearance(getIndex(pn));
+      }
+      /**
+       * @brief Check if any occupied cell is within the radius r by index
+       *
+       * Requires the clearance layer, see `updateClearance()`
+       */
+      bool isOccupied(int idx, decimal_t r) const {
+        const decimal_t rn = r / res_;
+        return (decimal_t) clearance_[idx] <= rn * rn;
+      }
+      /**
+       * @brief Check if any occupied cell is within the radius r by coordinate
+       *
+       * If the clearance layer is not computed, fall back to check the cell only
+       */
+      bool isOccupied(const Veci<Dim> &pn, decimal_t r) const {
+        if (isOutside(pn))
+          return false;
+        if (clearance_.empty() || r <= 0)
+          return isOccupied(getIndex(pn));
+        return isOccupied(getIndex(pn), r);
+      }
+      ///Check if the given cell is free and no occupied cell is within the radius r
+      bool isFree(const Veci<Dim> &pn, decimal_t r) const {
+        return isFree(pn) && !isOccupied(pn, r);
+      }
+
       /**
        * @brief Set map
        *
@@ -89,10 +139,54 @@ namespace MPL {
         dim_ = dim;
         origin_d_ = ori;
         res_ = res;
+        if (!clearance_.empty())
+          updateClearance();
+      }
+
+      /**
+       * @brief Compute the clearance layer
+       *
+       * The squared Euclidean distance from each cell to the nearest occupied
+       * cell is computed once with the separable distance transform, so that
+       * robots with different radius can share the same map instead of
+       * dilating a copy for each of them.
+       */
+      void updateClearance() {
+        int size = 1;
+        for (int i = 0; i < Dim; i++)
+          size *= dim_(i);
+        const decimal_t inf = std::numeric_limits<decimal_t>::max() / 4;
+        std::vector<decimal_t> dist(size);
+        for (int idx = 0; idx < size; idx++)
+          dist[idx] = isOccupied(idx) ? 0 : inf;
+
+        int max_dim = dim_.maxCoeff();
+        std::vector<decimal_t> f(max_dim), d(max_dim), z(max_dim + 1);
+        std::vector<int> v(max_dim);
+        int stride = 1;
+        for (int k = 0; k < Dim; k++) {
+          const int n = dim_(k);
+          for (int idx = 0; idx < size; idx++) {
+            // start from the first cell of each line along axis k
+            if ((idx / stride) % n != 0)
+              continue;
+            for (int q = 0; q < n; q++)
+              f[q] = dist[idx + q * stride];
+            distanceTransform1D(f, n, inf, v, z, d);
+            for (int q = 0; q < n; q++)
+              dist[idx + q * stride] = d[q];
+          }
+          stride *= n;
+        }
+
+        const decimal_t max_val = std::numeric_limits<uint16_t>::max();
+        clearance_.resize(size);
+        for (int idx = 0; idx < size; idx++)
+          clearance_[idx] = dist[idx] < max_val ? (uint16_t) dist[idx] : max_val;
       }
 
       ///Print basic information about the util
-      void info() {
+      void info() const {
         Vecf<Dim> range = dim_.template cast<decimal_t>() * res_;
         std::cout << "MapUtil Info ========================== " << std::endl;
         std::cout << "   res: [" << res_ << "]" << std::endl;
@@ -102,20 +196,20 @@ namespace MPL {
       };
 
       ///Float position to discrete cell coordinate
-      Veci<Dim> floatToInt(const Vecf<Dim> &pt) {
+      Veci<Dim> floatToInt(const Vecf<Dim> &pt) const {
         Veci<Dim> pn;
         for(int i = 0; i < Dim; i++)
           pn(i) = std::round((pt(i) - origin_d_(i)) / res_ - 0.5);
         return pn;
       }
       ///Discrete cell coordinate to float position
-      Vecf<Dim> intToFloat(const Veci<Dim> &pn) {
+      Vecf<Dim> intToFloat(const Veci<Dim> &pn) const {
         //return pn.template cast<decimal_t>() * res_ + origin_d_;
         return (pn.template cast<decimal_t>() + Vecf<Dim>::Constant(0.5)) * res_ + origin_d_;
       }
 
       ///Raytrace from float point pt1 to pt2
-      vec_Veci<Dim> rayTrace(const Vecf<Dim> &pt1, const Vecf<Dim> &pt2) {
+      vec_Veci<Dim> rayTrace(const Vecf<Dim> &pt1, const Vecf<Dim> &pt2) const {
         Vecf<Dim> diff = pt2 - pt1;
         decimal_t k = 0.8;
         int max_diff = (diff / res_).template lpNorm<Eigen::Infinity>() / k;
@@ -139,7 +233,7 @@ namespace MPL {
       ///Get occupied voxels for 3D
       template<int U = Dim>
         typename std::enable_if<U == 3, vec_Vec3f>::type
-        getCloud() {
+        getCloud() const {
           vec_Vecf<Dim> cloud;
           Veci<Dim> n;
           for (n(0) = 0; n(0) < dim_(0); n(0)++) {
@@ -155,7 +249,7 @@ namespace MPL {
       ///Get occupied voxels for 2D
       template<int U = Dim>
         typename std::enable_if<U == 2, vec_Vec2f>::type
-        getCloud() {
+        getCloud() const {
           vec_Vecf<Dim> cloud;
           Veci<Dim> n;
 
@@ -171,7 +265,7 @@ namespace MPL {
       ///Get free voxels for 3D
       template<int U = Dim>
         typename std::enable_if<U == 3, vec_Vec3f>::type
-        getFreeCloud() {
+        getFreeCloud() const {
           vec_Vecf<Dim> cloud;
           Veci<Dim> n;
           for (n(0) = 0; n(0) < dim_(0); n(0)++) {
@@ -188,7 +282,7 @@ namespace MPL {
       ///Get free voxels for 2D
       template<int U = Dim>
         typename std::enable_if<U == 2, vec_Vec2f>::type
-        getFreeCloud() {
+        getFreeCloud() const {
           vec_Vecf<Dim> cloud;
           Veci<Dim> n;
           for (n(0) = 0; n(0) < dim_(0); n(0)++) {
@@ -203,7 +297,7 @@ namespace MPL {
       ///Get unknown voxels for 3D
       template<int U = Dim>
         typename std::enable_if<U == 3, vec_Vec3f>::type
-        getUnknownCloud() {
+        getUnknownCloud() const {
           vec_Vecf<Dim> cloud;
           Veci<Dim> n;
           for (n(0) = 0; n(0) < dim_(0); n(0)++) {
@@ -220,7 +314,7 @@ namespace MPL {
       ///Get unknown voxels for 2D
       template<int U = Dim>
         typename std::enable_if<U == 2, vec_Vec2f>::type
-        getUnknownCloud() {
+        getUnknownCloud() const {
           vec_Vecf<Dim> cloud;
           Veci<Dim> n;
           for (n(0) = 0; n(0) < dim_(0); n(0)++) {
@@ -264,6 +358,8 @@ namespace MPL {
         }
 
         map_ = map;
+        if (!clearance_.empty())
+          updateClearance();
       }
 
       ///Free unknown voxels
@@ -308,6 +404,8 @@ namespace MPL {
             }
           }
         }
+        if (!clearance_.empty())
+          updateClearance();
       }
 
       void freeRobot_r(double robot_r){     
@@ -332,10 +430,44 @@ namespace MPL {
             }
           }
         }
+        if (!clearance_.empty())
+          updateClearance();
       }
 
 
     protected:
+      /**
+       * @brief 1D squared distance transform of the sampled function f
+       *
+       * Lower envelope of parabolas as in Felzenszwalb and Huttenlocher
+       */
+      static void distanceTransform1D(const std::vector<decimal_t> &f, int n,
+                                      decimal_t inf, std::vector<int> &v,
+                                      std::vector<decimal_t> &z,
+                                      std::vector<decimal_t> &d) {
+        int k = 0;
+        v[0] = 0;
+        z[0] = -inf;
+        z[1] = inf;
+        for (int q = 1; q < n; q++) {
+          decimal_t s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+          while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+          }
+          k++;
+          v[k] = q;
+          z[k] = s;
+          z[k + 1] = inf;
+        }
+        k = 0;
+        for (int q = 0; q < n; q++) {
+          while (z[k + 1] < q)
+            k++;
+          d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+        }
+      }
+
       ///Resolution
       decimal_t res_;
       ///Origin, float type
@@ -344,6 +476,8 @@ namespace MPL {
       Veci<Dim> dim_;
       ///Map entity
       Tmap map_;
+      ///Clearance layer, empty if not computed
+      Tclearance clearance_;
 
       ///Assume occupied cell has value 100
       int8_t val_occ = 100;
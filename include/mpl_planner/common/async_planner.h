@@ -0,0 +1,202 @@
+/**
+ * @file async_planner.h
+ * @brief run the planning on a worker thread
+ */
+#ifndef MPL_ASYNC_PLANNER_H
+#define MPL_ASYNC_PLANNER_H
+
+#include <condition_variable>
+#include <future>
+#include <mpl_planner/common/planner_base.h>
+#include <mutex>
+#include <thread>
+
+namespace MPL {
+
+/**
+ * @brief Asynchronous front-end of a planner
+ *
+ * The planner runs on a worker thread owned by this class. `submit()` returns
+ * immediately with a future of the result; a new request pre-empts the
+ * running one through the cancel flag polled in the expansion loop, and
+ * replaces a request still waiting in the queue. The planner must not be used
+ * directly while a request is running.
+ */
+template <int Dim, typename Coord = Waypoint<Dim>> class AsyncPlanner {
+public:
+  /// Outcome of a request
+  enum Status {
+    SUCCESS,   ///< reached the goal
+    FAILURE,   ///< no trajectory within the limits
+    PARTIAL,   ///< stopped by the deadline, the trajectory is partial
+    CANCELLED, ///< pre-empted or cancelled before reaching the goal
+  };
+
+  /// Result of a request
+  struct Result {
+    Status status = CANCELLED;
+    /// Trajectory, empty unless SUCCESS or PARTIAL
+    Trajectory<Dim> traj;
+    /// Number of expansions
+    int expansions = 0;
+  };
+
+  /// Snapshot of the progress of the running request
+  struct Progress {
+    bool running = false;
+    int expansions = 0;
+    decimal_t best_f = std::numeric_limits<decimal_t>::infinity();
+  };
+
+  /// Start the worker thread on the planner
+  explicit AsyncPlanner(const std::shared_ptr<PlannerBase<Dim, Coord>> &planner)
+      : planner_(planner) {
+    planner_->setCancelFlag(&cancel_);
+    planner_->setProgress(&progress_);
+    worker_ = std::thread(&AsyncPlanner::run, this);
+  }
+
+  /// Cancel the requests and join the worker thread
+  ~AsyncPlanner() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      cancel_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    planner_->setCancelFlag(nullptr);
+    planner_->setProgress(nullptr);
+  }
+
+  AsyncPlanner(const AsyncPlanner &) = delete;
+  AsyncPlanner &operator=(const AsyncPlanner &) = delete;
+
+  /// Submit a request, the running and queued requests are cancelled
+  std::shared_future<Result> submit(const Coord &start, const Coord &goal) {
+    std::unique_ptr<Request> request(new Request(start, goal));
+    std::shared_future<Result> result = request->promise.get_future().share();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_)
+        pending_->promise.set_value(Result());
+      pending_ = std::move(request);
+      cancel_ = running_;
+    }
+    cv_.notify_all();
+    return result;
+  }
+
+  /// Cancel the running and queued requests
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_) {
+      pending_->promise.set_value(Result());
+      pending_.reset();
+    }
+    cancel_ = running_;
+    // the worker only wakes up the callers of wait() after a request
+    if (!running_)
+      idle_cv_.notify_all();
+  }
+
+  /// Check if a request is running or queued
+  bool busy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_ || pending_;
+  }
+
+  /// Wait until the running and queued requests are done
+  void wait() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return !running_ && !pending_; });
+  }
+
+  /// Poll the progress of the running request
+  Progress progress() const {
+    Progress p;
+    p.running = busy();
+    p.expansions = progress_.expansions.load(std::memory_order_relaxed);
+    p.best_f = progress_.best_f.load(std::memory_order_relaxed);
+    return p;
+  }
+
+  /// Planner, only safe to use when not `busy()`
+  const std::shared_ptr<PlannerBase<Dim, Coord>> &planner() const {
+    return planner_;
+  }
+
+private:
+  struct Request {
+    Request(const Coord &start, const Coord &goal) : start(start), goal(goal) {}
+    Coord start;
+    Coord goal;
+    std::promise<Result> promise;
+  };
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stop_ || pending_; });
+      if (stop_) {
+        if (pending_)
+          pending_->promise.set_value(Result());
+        pending_.reset();
+        idle_cv_.notify_all();
+        return;
+      }
+      std::unique_ptr<Request> request = std::move(pending_);
+      running_ = true;
+      cancel_ = false;
+      lock.unlock();
+
+      try {
+        Result result;
+        const bool success = planner_->plan(request->start, request->goal);
+        if (success)
+          result.status = SUCCESS;
+        else if (planner_->isPartial())
+          result.status = PARTIAL;
+        else if (planner_->isCancelled())
+          result.status = CANCELLED;
+        else
+          result.status = FAILURE;
+        if (result.status == SUCCESS || result.status == PARTIAL)
+          result.traj = planner_->getTraj();
+        result.expansions = planner_->getExpandedNum();
+        request->promise.set_value(result);
+      } catch (...) {
+        request->promise.set_exception(std::current_exception());
+      }
+
+      lock.lock();
+      running_ = false;
+      if (!pending_)
+        idle_cv_.notify_all();
+    }
+  }
+
+  /// Planner run by the worker
+  std::shared_ptr<PlannerBase<Dim, Coord>> planner_;
+  /// Guards the requests and the flags below
+  mutable std::mutex mutex_;
+  /// Wakes up the worker
+  std::condition_variable cv_;
+  /// Wakes up the callers of `wait()`
+  mutable std::condition_variable idle_cv_;
+  /// Request waiting for the worker
+  std::unique_ptr<Request> pending_;
+  /// Set while the worker plans
+  bool running_ = false;
+  /// Set to stop the worker
+  bool stop_ = false;
+  /// Polled by the search
+  std::atomic<bool> cancel_{false};
+  /// Written by the search
+  SearchProgress progress_;
+  /// Worker thread, started last
+  std::thread worker_;
+};
+}
+
+#endif
@@ -6,7 +6,9 @@
 #ifndef MPL_ENV_BASE_H
 #define MPL_ENV_BASE_H
 
+#include <mpl_basis/trace.h>
 #include <mpl_basis/trajectory.h>
+#include <mpl_planner/common/search_stats.h>
 
 namespace MPL {
 
@@ -60,7 +62,8 @@ class env_base {
                                const Waypoint<Dim>& goal) const {
       if(heur_ignore_dynamics_) {
         if(v_max_ > 0) {
-          return w_*(state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_;
+          return w_*std::max((state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_,
+                             cal_yaw_time(state, goal));
         }
         else
           return w_*(state.pos - goal.pos).template lpNorm<Eigen::Infinity>();
@@ -81,7 +84,8 @@ class env_base {
         decimal_t f = 2880*dp.dot(v0+v1);
         decimal_t g = -3600*dp.dot(dp);
 
-        std::vector<decimal_t> ts = solve(a, b, c, d, e, f, g);
+        Roots ts;
+        solve(a, b, c, d, e, f, g, ts);
 
         decimal_t t_bar = (state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_;
         ts.push_back(t_bar);
@@ -110,7 +114,8 @@ class env_base {
         decimal_t f = dp.dot(1600*v0+960*v1);
         decimal_t g = -1600*dp.dot(dp);
 
-        std::vector<decimal_t> ts = solve(a, b, c, d, e, f, g);
+        Roots ts;
+        solve(a, b, c, d, e, f, g, ts);
 
         decimal_t t_bar = (state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_;
         ts.push_back(t_bar);
@@ -139,7 +144,8 @@ class env_base {
         decimal_t f = 160*dp.dot(v0);
         decimal_t g = -100*dp.dot(dp);
 
-        std::vector<decimal_t> ts = solve(a, b, c, d, e, f, g);
+        Roots ts;
+        solve(a, b, c, d, e, f, g, ts);
 
         decimal_t t_bar = (state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_;
         ts.push_back(t_bar);
@@ -166,7 +172,8 @@ class env_base {
         decimal_t c4 = 0;
         decimal_t c5 = w_;
 
-        std::vector<decimal_t> ts = quartic(c5, c4, c3, c2, c1);
+        Roots ts;
+        solve(c5, c4, c3, c2, c1, ts);
         decimal_t t_bar = (state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_;
         ts.push_back(t_bar);
 
@@ -192,7 +199,8 @@ class env_base {
         decimal_t c4 = 0;
         decimal_t c5 = w_;
 
-        std::vector<decimal_t> ts = quartic(c5, c4, c3, c2, c1);
+        Roots ts;
+        solve(c5, c4, c3, c2, c1, ts);
         decimal_t t_bar = (state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_;
         ts.push_back(t_bar);
 
@@ -207,12 +215,114 @@ class env_base {
 
         return cost;
       }
+      else if(state.control == Control::SNP || state.use_yaw) {
+        // Min effort plus time with only the goal position fixed, since
+        // is_goal() checks the other derivatives within tolerances if at all.
+        // Yaw only bounds the time, as the heading cost can be avoided by
+        // turning in place. The L2 distance over v_max is kept as a floor.
+        const int n = 1 + state.use_vel + state.use_acc + state.use_jrk;
+        decimal_t t_lb = cal_yaw_time(state, goal);
+        if(v_max_ > 0)
+          t_lb = std::max(t_lb, (state.pos - goal.pos).template lpNorm<Eigen::Infinity>() / v_max_);
+        const decimal_t cost = cal_heur_bvp(state, goal, n, 1, t_lb);
+        if(v_max_ > 0)
+          return std::max(cost, w_*(state.pos - goal.pos).norm() / v_max_);
+        return cost;
+      }
       else if(state.control == Control::VEL && goal.control == Control::VEL)
         return (w_ + 1) * (state.pos - goal.pos).norm();
       else
         return w_*(state.pos - goal.pos).norm() / v_max_;
     }
 
+    /**
+     * @brief Min effort plus time cost from state to goal with n-th order control
+     * @param n order of the control, up to 4 for snap
+     * @param k number of derivatives fixed at the goal, from position up
+     * @param t_lb lower bound of the duration
+     *
+     * The min effort to reach the goal in time \f$T\f$ is \f$d^TW^{-1}d\f$,
+     * where \f$W\f$ is the controllability Gramian over the k fixed derivatives
+     * and \f$d\f$ is their gap to the coasting state. It equals
+     * \f$P(T)/T^{2n-1}\f$ for a polynomial \f$P\f$ of degree \f$2n-2\f$,
+     * so the stationary points of the cost are roots of a polynomial of
+     * degree \f$2n\f$.
+     */
+    decimal_t cal_heur_bvp(const Waypoint<Dim>& state, const Waypoint<Dim>& goal,
+                           int n, int k, decimal_t t_lb) const {
+      const Vecf<Dim>* x0[4] = {&state.pos, &state.vel, &state.acc, &state.jrk};
+      const Vecf<Dim>* x1[4] = {&goal.pos, &goal.vel, &goal.acc, &goal.jrk};
+      // W(i, j) = H(i, j) * T^(2n-1-i-j)
+      Eigen::Matrix<decimal_t, Eigen::Dynamic, Eigen::Dynamic, 0, 4, 4> H(k, k);
+      for(int i = 0; i < k; i++) {
+        for(int j = 0; j < k; j++)
+          H(i, j) = 1.0 / (factorial(n-1-i) * factorial(n-1-j) * (2*n-1-i-j));
+      }
+      const Eigen::Matrix<decimal_t, Eigen::Dynamic, Eigen::Dynamic, 0, 4, 4> H_inv = H.inverse();
+
+      // P in ascending order, from e_i(T) = T^i * d_i(T)
+      decimal_t P[7] = {0, 0, 0, 0, 0, 0, 0};
+      for(int dim = 0; dim < Dim; dim++) {
+        decimal_t e[4][4] = {{0}};
+        for(int i = 0; i < k; i++) {
+          e[i][i] = (*x1[i])(dim) - (*x0[i])(dim);
+          for(int l = i + 1; l < n; l++)
+            e[i][l] = -(*x0[l])(dim) / factorial(l-i);
+        }
+        for(int i = 0; i < k; i++) {
+          for(int j = 0; j < k; j++) {
+            for(int a = i; a < n; a++) {
+              for(int b = j; b < n; b++)
+                P[a+b] += H_inv(i, j) * e[i][a] * e[j][b];
+            }
+          }
+        }
+      }
+
+      // T^(2n) * d(cost)/dT = T*P'(T) - (2n-1)*P(T) + w*T^(2n), highest order first
+      decimal_t g[9];
+      g[0] = w_;
+      for(int m = 2*n-1; m >= 0; m--)
+        g[2*n-m] = (m-2*n+1) * (m < 2*n-1 ? P[m] : 0);
+      Roots ts;
+      solve(g, 2*n, ts);
+      ts.push_back(t_lb);
+
+      decimal_t min_cost = std::numeric_limits<decimal_t>::max();
+      for(auto t: ts) {
+        if(t < t_lb || t <= 0)
+          continue;
+        // P(T)/T^(2n-1) by Horner in 1/T
+        const decimal_t s = 1 / t;
+        decimal_t cost = P[0];
+        for(int m = 1; m <= 2*n-2; m++)
+          cost = cost * s + P[m];
+        cost = cost * s + w_ * t;
+        if(cost < min_cost)
+          min_cost = cost;
+      }
+      return min_cost == std::numeric_limits<decimal_t>::max() ? 0 : min_cost;
+    }
+
+    /**
+     * @brief Lower bound of the time to turn to the goal yaw
+     *
+     * Yaw is driven at constant rate by the last entry of the control input,
+     * and the goal region only checks yaw if `tol_yaw_` is positive.
+     */
+    decimal_t cal_yaw_time(const Waypoint<Dim>& state,
+                           const Waypoint<Dim>& goal) const {
+      if(!state.use_yaw || !goal.use_yaw || tol_yaw_ <= 0)
+        return 0;
+      decimal_t yaw_rate = 0;
+      for(const auto& u: U_) {
+        if(u.size() > Dim)
+          yaw_rate = std::max(yaw_rate, std::abs(u(Dim)));
+      }
+      const decimal_t dyaw = std::abs(normalize_angle(goal.yaw - state.yaw)) - tol_yaw_;
+      return yaw_rate > 0 && dyaw > 0 ? dyaw / yaw_rate : 0;
+    }
+
     ///Replace the original cast function
     inline Veci<Dim> round(const Vecf<Dim>& vec, decimal_t res) const {
       Veci<Dim> vecI;
@@ -314,8 +424,9 @@ class env_base {
     virtual void set_prior_trajectory(const Trajectory<Dim>& traj) {
       prior_traj_.clear();
       decimal_t total_time = traj.getTotalTime();
+      auto cursor = traj.cursor();
       for(decimal_t t = 0; t < total_time; t += dt_) {
-        prior_traj_.push_back(std::make_pair(traj.evaluate(t),
+        prior_traj_.push_back(std::make_pair(cursor.evaluate(t),
                                              w_*(total_time - t)));
       }
     }
@@ -396,6 +507,14 @@ class env_base {
     virtual void set_gradient_map(const vec_E<Vecf<Dim>>& map) {
     }
 
+    ///set robot radius for collision checking
+    virtual void set_robot_radius(decimal_t r) {
+    }
+
+    ///set polygon footprint for collision checking
+    virtual void set_footprint(const vec_Vec2f& vertices) {
+    }
+
     ///Set max time
     void set_t_max(int t) {
       t_max_ = t;
@@ -520,8 +639,6 @@ class env_base {
     decimal_t dj_{0.1};
     ///grid size in yaw
     decimal_t dyaw_{0.1};
-    ///expanded nodes
-    mutable vec_Vecf<Dim> expanded_nodes_;
     ///Array of constant control input
     vec_E<VecDf> U_;
     ///Goal node
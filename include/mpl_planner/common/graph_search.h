@@ -6,11 +6,21 @@
 #ifndef MPL_GRAPH_SEARCH_H
 #define MPL_GRAPH_SEARCH_H
 
+#include <atomic>
+#include <chrono>
 #include <mpl_planner/common/state_space.h>
 #include <mpl_basis/trajectory.h>
 
 namespace MPL {
 
+/// Progress of a running search, written with relaxed atomics
+struct SearchProgress {
+  /// Number of expansions so far
+  std::atomic<int> expansions{0};
+  /// f value of the last expanded state, a lower bound of the cost to goal
+  std::atomic<decimal_t> best_f{std::numeric_limits<decimal_t>::infinity()};
+};
+
 /**
  * @brief GraphSearch class
  *
@@ -25,6 +35,28 @@ public:
    */
   GraphSearch(bool verbose = false) : verbose_(verbose){};
 
+  /**
+   * @brief Set the wall-clock deadline of the search
+   *
+   * Once passed, the search stops and returns the trajectory to the closed
+   * state with the lowest heuristic, and `partial()` is set.
+   */
+  void setDeadline(const std::chrono::steady_clock::time_point &deadline) {
+    deadline_ = deadline;
+  }
+
+  /// Check if the last search was stopped by the deadline with a trajectory
+  bool partial() const { return partial_; }
+
+  /// Set the flag polled by the search, it stops as soon as the flag is set
+  void setCancelFlag(const std::atomic<bool> *cancel) { cancel_ = cancel; }
+
+  /// Check if the last search was stopped by the cancel flag
+  bool cancelled() const { return cancelled_; }
+
+  /// Set the progress written at each expansion
+  void setProgress(SearchProgress *progress) { progress_ = progress; }
+
   /**
    * @brief Astar graph search
    *
@@ -43,6 +75,10 @@ public:
                   std::shared_ptr<StateSpace<Dim, Coord>> &ss_ptr,
                   Trajectory<Dim> &traj, int max_expand = -1,
                   decimal_t max_t = 0) {
+    MPL_TRACE_SCOPE("GraphSearch::Astar");
+    partial_ = false;
+    cancelled_ = false;
+    resetProgress();
     // Check if done
     if (ENV->is_goal(start_coord))
       return 0;
@@ -54,22 +90,43 @@ public:
         printf(ANSI_COLOR_GREEN "Start from new node!\n" ANSI_COLOR_RESET);
       currNode_ptr = std::make_shared<State<Coord>>(start_key, start_coord);
       currNode_ptr->g = 0;
-      currNode_ptr->h = ss_ptr->eps_ == 0 ? 0 : ENV->get_heur(start_coord);
+      MPL_STATS_TIME(heuristic, currNode_ptr->h = ss_ptr->eps_ == 0
+                                    ? 0 : ENV->get_heur(start_coord));
       decimal_t fval = currNode_ptr->g + ss_ptr->eps_ * currNode_ptr->h;
-      currNode_ptr->heapkey =
-        ss_ptr->pq_.push(std::make_pair(fval, currNode_ptr));
+      MPL_STATS_TIME(heap_push, currNode_ptr->heapkey = ss_ptr->pq_.push(
+                                    std::make_pair(fval, currNode_ptr)));
       currNode_ptr->iterationopened = true;
       currNode_ptr->iterationclosed = false;
       ss_ptr->hm_[start_key] = currNode_ptr;
     }
 
+    const bool use_deadline = deadline_ != Clock::time_point::max();
+    StatePtr<Coord> bestNode_ptr;
     int expand_iteration = 0;
+    ss_ptr->expand_iteration_ = 0;
     while (true) {
+      if (cancelRequested())
+        return false;
       expand_iteration++;
+      // recorded here so that every exit reports the expansions
+      ss_ptr->expand_iteration_ = expand_iteration;
+      if (ss_ptr->memory_sample_interval_ > 0 &&
+          expand_iteration % ss_ptr->memory_sample_interval_ == 0)
+        ss_ptr->sampleMemory();
       // get element with smallest cost
-      currNode_ptr = ss_ptr->pq_.top().second;
-      ss_ptr->pq_.pop();
+      updateProgress(expand_iteration, ss_ptr->pq_.top().first);
+      MPL_STATS_TIME(heap_pop, currNode_ptr = ss_ptr->pq_.top().second;
+                     ss_ptr->pq_.pop());
       currNode_ptr->iterationclosed = true; // Add to closed list
+      if (use_deadline && (!bestNode_ptr || currNode_ptr->h < bestNode_ptr->h))
+        bestNode_ptr = currNode_ptr;
+      // After an eviction, children might already be linked to this state
+      const bool relink = ss_ptr->evicted_num_ > 0;
+      // As in SMA*, a state re-opened by an eviction only regenerates its
+      // best forgotten child
+      const bool regenerate = !currNode_ptr->forgotten_hashkey.empty();
+      const Key forgotten_key =
+          regenerate ? ss_ptr->popForgotten(*currNode_ptr) : Key();
 
       // Get successors
       vec_E<Coord> succ_coord;
@@ -77,8 +134,8 @@ public:
       std::vector<decimal_t> succ_cost;
       std::vector<int> succ_act_id;
 
-      ENV->get_succ(currNode_ptr->coord, succ_coord, succ_key, succ_cost,
-                    succ_act_id);
+      MPL_STATS_TIME(get_succ, ENV->get_succ(currNode_ptr->coord, succ_coord,
+                                             succ_key, succ_cost, succ_act_id));
 
       // Process successors (satisfy dynamic constraints but might hit obstacles)
       for (unsigned s = 0; s < succ_coord.size(); ++s) {
@@ -86,11 +143,22 @@ public:
         if (std::isinf(succ_cost[s]))
           continue;
 
-        // Get child
-        StatePtr<Coord> &succNode_ptr = ss_ptr->hm_[succ_key[s]];
+        // Get child, only the forgotten one is created again
+        typename hashMap<Coord>::iterator search;
+        if (regenerate && succ_key[s] != forgotten_key) {
+          MPL_STATS_TIME(hash_lookup, search = ss_ptr->hm_.find(succ_key[s]));
+          if (search == ss_ptr->hm_.end())
+            continue;
+        } else
+          MPL_STATS_TIME(hash_lookup,
+                         search = ss_ptr->hm_.emplace(succ_key[s], nullptr).first);
+        StatePtr<Coord> &succNode_ptr = search->second;
         if (!succNode_ptr) {
-          succNode_ptr = std::make_shared<State<Coord>>(succ_key[s], succ_coord[s]);
-          succNode_ptr->h = ss_ptr->eps_ == 0 ? 0 : ENV->get_heur(succNode_ptr->coord);
+          MPL_STATS_TIME(hash_insert,
+                         succNode_ptr = std::make_shared<State<Coord>>(
+                             succ_key[s], succ_coord[s]));
+          MPL_STATS_TIME(heuristic, succNode_ptr->h = ss_ptr->eps_ == 0
+                                        ? 0 : ENV->get_heur(succNode_ptr->coord));
           /*
            * Comment this block if build multiple connected graph
            succNode_ptr->pred_hashkey.push_back(currNode_ptr->hashkey);
@@ -99,13 +167,17 @@ public:
            */
         }
 
-
         /**
          * Comment following if build single connected graph
          * */
-        succNode_ptr->pred_hashkey.push_back(currNode_ptr->hashkey);
-        succNode_ptr->pred_action_cost.push_back(succ_cost[s]);
-        succNode_ptr->pred_action_id.push_back(succ_act_id[s]);
+        if (!relink ||
+            std::find(succNode_ptr->pred_hashkey.begin(),
+                      succNode_ptr->pred_hashkey.end(),
+                      currNode_ptr->hashkey) == succNode_ptr->pred_hashkey.end()) {
+          succNode_ptr->pred_hashkey.push_back(currNode_ptr->hashkey);
+          succNode_ptr->pred_action_cost.push_back(succ_cost[s]);
+          succNode_ptr->pred_action_id.push_back(succ_act_id[s]);
+        }
         //*/
 
         // see if we can improve the value of successor
@@ -136,22 +208,36 @@ public:
 
             (*succNode_ptr->heapkey).first = fval; // update heap element
             // ss_ptr->pq.update(succNode_ptr->heapkey);
-            ss_ptr->pq_.increase(succNode_ptr->heapkey); // update heap
+            MPL_STATS_TIME(heap_update, ss_ptr->pq_.increase(
+                                            succNode_ptr->heapkey)); // update heap
             // printf(ANSI_COLOR_RED "ASTAR ERROR!\n" ANSI_COLOR_RESET);
           } else // new node, add to heap
           {
             // std::cout << "ADD fval = " << fval << std::endl;
-            succNode_ptr->heapkey =
-              ss_ptr->pq_.push(std::make_pair(fval, succNode_ptr));
+            MPL_STATS_TIME(heap_push,
+                           succNode_ptr->heapkey = ss_ptr->pq_.push(
+                               std::make_pair(fval, succNode_ptr)));
             succNode_ptr->iterationopened = true;
+            // a closed state with a better g is opened again
+            succNode_ptr->iterationclosed = false;
           }
         }
       }
 
+      // Stay open for the other forgotten children
+      if (regenerate && !currNode_ptr->forgotten_hashkey.empty())
+        ss_ptr->reopen(currNode_ptr,
+                       *std::min_element(currNode_ptr->forgotten_fval.begin(),
+                                         currNode_ptr->forgotten_fval.end()));
+
       // If goal reached, abort!
       if (ENV->is_goal(currNode_ptr->coord))
         break;
 
+      // If the memory budget is exceeded, forget leaves
+      if (ss_ptr->overBudget())
+        ss_ptr->evict();
+
       // If maximum time reached, abort!
       if (max_t > 0 && currNode_ptr->coord.t >= max_t && !std::isinf(currNode_ptr->g)) {
         if (verbose_)
@@ -161,6 +247,21 @@ public:
         return false;
       }
 
+      // If the deadline passed, return the best partial trajectory
+      if (use_deadline && Clock::now() >= deadline_) {
+        if (verbose_)
+          printf(ANSI_COLOR_YELLOW
+                 "Deadline Reached after [%d] expansions!\n" ANSI_COLOR_RESET,
+                 expand_iteration);
+        // the best state might have been evicted by the memory budget
+        if (!ss_ptr->hm_.count(bestNode_ptr->hashkey))
+          bestNode_ptr = currNode_ptr;
+        traj = recoverTraj(bestNode_ptr, ss_ptr, ENV, start_key);
+        // a failure if the best state is still the start
+        partial_ = !traj.segs.empty();
+        return false;
+      }
+
       // If maximum expansion reached, abort!
       if (max_expand > 0 && expand_iteration >= max_expand) {
         printf(ANSI_COLOR_RED
@@ -192,7 +293,6 @@ public:
         printf(ANSI_COLOR_GREEN "Reached Goal !!!!!!\n\n" ANSI_COLOR_RESET);
     }
 
-    ss_ptr->expand_iteration_ = expand_iteration;
     traj = recoverTraj(currNode_ptr, ss_ptr, ENV, start_key);
     //return currNode_ptr->g;
     return true;
@@ -217,6 +317,10 @@ public:
                     std::shared_ptr<StateSpace<Dim, Coord>> &ss_ptr,
                     Trajectory<Dim> &traj, int max_expand = -1,
                     decimal_t max_t = 0) {
+    MPL_TRACE_SCOPE("GraphSearch::LPAstar");
+    partial_ = false;
+    cancelled_ = false;
+    resetProgress();
     // Check if done
     if (ENV->is_goal(start_coord)) {
       if (verbose_)
@@ -237,9 +341,10 @@ public:
       currNode_ptr = std::make_shared<State<Coord>>(start_key, start_coord);
       currNode_ptr->g = std::numeric_limits<decimal_t>::infinity();
       currNode_ptr->rhs = 0;
-      currNode_ptr->h = ss_ptr->eps_ == 0 ? 0 : ENV->get_heur(start_coord);
-      currNode_ptr->heapkey = ss_ptr->pq_.push(
-        std::make_pair(ss_ptr->calculateKey(currNode_ptr), currNode_ptr));
+      MPL_STATS_TIME(heuristic, currNode_ptr->h = ss_ptr->eps_ == 0
+                                    ? 0 : ENV->get_heur(start_coord));
+      MPL_STATS_TIME(heap_push, currNode_ptr->heapkey = ss_ptr->pq_.push(
+        std::make_pair(ss_ptr->calculateKey(currNode_ptr), currNode_ptr)));
       currNode_ptr->iterationopened = true;
       currNode_ptr->iterationclosed = false;
       ss_ptr->hm_[start_key] = currNode_ptr;
@@ -251,18 +356,32 @@ public:
          ENV->is_goal(ss_ptr->best_child_.back()->coord))
       goalNode_ptr = ss_ptr->best_child_.back();
 
+    const bool use_deadline = deadline_ != Clock::time_point::max();
+    StatePtr<Coord> bestNode_ptr;
     int expand_iteration = 0;
+    ss_ptr->expand_iteration_ = 0;
     while (ss_ptr->pq_.top().first < ss_ptr->calculateKey(goalNode_ptr) ||
            goalNode_ptr->rhs != goalNode_ptr->g) {
+      if (cancelRequested())
+        return std::numeric_limits<decimal_t>::infinity();
       expand_iteration++;
+      // recorded here so that every exit reports the expansions
+      ss_ptr->expand_iteration_ = expand_iteration;
+      if (ss_ptr->memory_sample_interval_ > 0 &&
+          expand_iteration % ss_ptr->memory_sample_interval_ == 0)
+        ss_ptr->sampleMemory();
       // Get element with smallest cost
-      currNode_ptr = ss_ptr->pq_.top().second;
-      ss_ptr->pq_.pop();
+      updateProgress(expand_iteration, ss_ptr->pq_.top().first);
+      MPL_STATS_TIME(heap_pop, currNode_ptr = ss_ptr->pq_.top().second;
+                     ss_ptr->pq_.pop());
       currNode_ptr->iterationclosed = true; // Add to closed list
 
-      if (currNode_ptr->g > currNode_ptr->rhs)
+      if (currNode_ptr->g > currNode_ptr->rhs) {
         currNode_ptr->g = currNode_ptr->rhs;
-      else {
+        if (use_deadline &&
+            (!bestNode_ptr || currNode_ptr->h < bestNode_ptr->h))
+          bestNode_ptr = currNode_ptr;
+      } else {
         currNode_ptr->g = std::numeric_limits<decimal_t>::infinity();
         ss_ptr->updateNode(currNode_ptr);
       }
@@ -276,8 +395,8 @@ public:
       bool explored = false;
       if (currNode_ptr->succ_hashkey.empty()) {
         explored = true;
-        ENV->get_succ(currNode_ptr->coord, succ_coord, succ_key, succ_cost,
-                      succ_act_id);
+        MPL_STATS_TIME(get_succ, ENV->get_succ(currNode_ptr->coord, succ_coord,
+                                               succ_key, succ_cost, succ_act_id));
         currNode_ptr->succ_coord.resize(succ_coord.size());
         currNode_ptr->succ_hashkey.resize(succ_coord.size());
         currNode_ptr->succ_action_id.resize(succ_coord.size());
@@ -287,10 +406,15 @@ public:
       // Process successors
       for (unsigned s = 0; s < succ_key.size(); ++s) {
         // Get child
-        StatePtr<Coord> &succNode_ptr = ss_ptr->hm_[succ_key[s]];
+        StatePtr<Coord> *succ_node;
+        MPL_STATS_TIME(hash_lookup, succ_node = &ss_ptr->hm_[succ_key[s]]);
+        StatePtr<Coord> &succNode_ptr = *succ_node;
         if (!(succNode_ptr)) {
-          succNode_ptr = std::make_shared<State<Coord>>(succ_key[s], succ_coord[s]);
-          succNode_ptr->h = ss_ptr->eps_ == 0 ? 0 : ENV->get_heur(succNode_ptr->coord);
+          MPL_STATS_TIME(hash_insert,
+                         succNode_ptr = std::make_shared<State<Coord>>(
+                             succ_key[s], succ_coord[s]));
+          MPL_STATS_TIME(heuristic, succNode_ptr->h = ss_ptr->eps_ == 0
+                                        ? 0 : ENV->get_heur(succNode_ptr->coord));
         }
 
         // store the hashkey
@@ -321,6 +445,21 @@ public:
       if (ENV->is_goal(currNode_ptr->coord) || max_t > 0)
         goalNode_ptr = currNode_ptr;
 
+      // If the deadline passed, return the best partial trajectory
+      if (use_deadline && Clock::now() >= deadline_) {
+        if (verbose_)
+          printf(ANSI_COLOR_YELLOW
+                 "Deadline Reached after [%d] expansions!\n" ANSI_COLOR_RESET,
+                 expand_iteration);
+        if (bestNode_ptr && !std::isinf(bestNode_ptr->g))
+          traj = recoverTraj(bestNode_ptr, ss_ptr, ENV, start_key);
+        else
+          traj = Trajectory<Dim>();
+        // a failure if no consistent state other than the start was closed
+        partial_ = !traj.segs.empty();
+        return std::numeric_limits<decimal_t>::infinity();
+      }
+
       // If maximum expansion reached, abort!
       if (max_expand > 0 && expand_iteration >= max_expand) {
         if (verbose_)
@@ -372,15 +511,37 @@ public:
     // printf("time for recovering: %f, expand: %d\n", elapsed_seconds.count(),
     // expand_iteration);
 
-    ss_ptr->expand_iteration_ = expand_iteration;
     return goalNode_ptr->g;
   }
 private:
+  /// Check the cancel flag and remember if it stops the search
+  bool cancelRequested() {
+    if (!cancel_ || !cancel_->load(std::memory_order_relaxed))
+      return false;
+    if (verbose_)
+      printf(ANSI_COLOR_YELLOW "Search cancelled!\n" ANSI_COLOR_RESET);
+    cancelled_ = true;
+    return true;
+  }
+
+  void resetProgress() {
+    updateProgress(0, std::numeric_limits<decimal_t>::infinity());
+  }
+
+  void updateProgress(int expansions, decimal_t f) {
+    if (progress_) {
+      progress_->expansions.store(expansions, std::memory_order_relaxed);
+      progress_->best_f.store(f, std::memory_order_relaxed);
+    }
+  }
+
   /// Recover trajectory
   Trajectory<Dim> recoverTraj(
     StatePtr<Coord> currNode_ptr,
     std::shared_ptr<StateSpace<Dim, Coord>> ss_ptr,
     const std::shared_ptr<env_base<Dim>> &ENV, const Key &start_key) {
+  MPL_TRACE_SCOPE("GraphSearch::recoverTraj");
+  MPL_STATS_SCOPE(recover);
   // Recover trajectory
   ss_ptr->best_child_.clear();
 
@@ -398,6 +559,9 @@ private:
     decimal_t min_g = std::numeric_limits<decimal_t>::infinity();
     for (unsigned int i = 0; i < currNode_ptr->pred_hashkey.size(); i++) {
       Key key = currNode_ptr->pred_hashkey[i];
+      // the predecessor might have been evicted by the memory budget
+      if (!ss_ptr->hm_.count(key))
+        continue;
       // std::cout << "action id: " << currNode_ptr->pred_action_id[i] << "
       // parent g: " << ss_ptr->hm_[key]->g << " action cost: " <<
       // currNode_ptr->pred_action_cost[i] << " parent key: " <<key <<
@@ -455,6 +619,17 @@ private:
   std::reverse(ss_ptr->best_child_.begin(), ss_ptr->best_child_.end());
   return Trajectory<Dim>(prs);
 }
+  typedef std::chrono::steady_clock Clock;
+  /// Deadline of the search
+  Clock::time_point deadline_ = Clock::time_point::max();
+  /// Set if the last search was stopped by the deadline
+  bool partial_ = false;
+  /// Flag to stop the search, can be null
+  const std::atomic<bool> *cancel_ = nullptr;
+  /// Set if the last search was stopped by the cancel flag
+  bool cancelled_ = false;
+  /// Progress of the search, can be null
+  SearchProgress *progress_ = nullptr;
   /// Verbose flag
   bool verbose_ = false;
 };
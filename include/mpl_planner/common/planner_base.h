@@ -143,13 +143,40 @@ public:
     }
     return ps;
   }
-  /// Get expanded points, for A* it should be the same as the close set
+  /**
+   * @brief Get expanded points, i.e. the close set
+   *
+   * Read from the state space of this planner, the environment stays
+   * unchanged by the search
+   */
   vec_Vecf<Dim> getExpandedNodes() const {
-    return ENV_->expanded_nodes_;
+    return ss_ptr_ ? getCloseSet() : vec_Vecf<Dim>();
   }
   /// Get number of expanded nodes
   int getExpandedNum() const {
-    return ss_ptr_->expand_iteration_;
+    return ss_ptr_ ? ss_ptr_->expand_iteration_ : 0;
+  }
+  /// Get number of states in the state space
+  size_t getStateNum() const {
+    return ss_ptr_ ? ss_ptr_->hm_.size() : 0;
+  }
+  /**
+   * @brief Get the memory used by the state space
+   *
+   * The peak covers the samples taken every `setMemorySampleInterval()`
+   * expansions, before each `getSubStateSpace()` and at this call.
+   */
+  StateSpaceMemory getMemoryStats() const {
+    return ss_ptr_ ? ss_ptr_->memory() : StateSpaceMemory();
+  }
+  /**
+   * @brief Get the counters of the last plan
+   *
+   * Only filled if the library is built with `MPL_SEARCH_STATS`, see
+   * `SearchStats::enabled`
+   */
+  const SearchStats &getSearchStats() const {
+    return search_stats_;
   }
   /**
    * @brief Prune state space
@@ -207,6 +234,40 @@ public:
     if (planner_verbose_)
       printf("[PlannerBase] set max time: %f\n", t);
   }
+  /**
+   * @brief Set the wall-clock deadline of each plan
+   * @param timeout_us deadline in microseconds from the call of `plan()`,
+   * 0 means no limitation
+   *
+   * When the deadline fires, `plan()` returns false with the trajectory to
+   * the closed state closest to the goal, see `isPartial()`
+   */
+  void setTimeout(long timeout_us) {
+    timeout_us_ = timeout_us;
+    if (planner_verbose_)
+      printf("[PlannerBase] set timeout: %ld us\n", timeout_us_);
+  }
+  /// Check if the last plan was stopped by the deadline with a partial trajectory
+  bool isPartial() const {
+    return partial_;
+  }
+  /**
+   * @brief Set the flag polled at each expansion to cancel the plan
+   *
+   * The flag can be set from another thread, `plan()` then returns false
+   * and `isCancelled()` is set. Null disables the cancellation.
+   */
+  void setCancelFlag(const std::atomic<bool> *cancel) {
+    cancel_ = cancel;
+  }
+  /// Check if the last plan was cancelled
+  bool isCancelled() const {
+    return cancelled_;
+  }
+  /// Set the progress updated at each expansion, it can be read from another thread
+  void setProgress(SearchProgress *progress) {
+    progress_ = progress;
+  }
   /// Set dt for each primitive
   void setDt(decimal_t dt) {
     ENV_->set_dt(dt);
@@ -237,6 +298,12 @@ public:
     if (planner_verbose_)
       printf("[PlannerBase] set dj: %f\n", dj);
   }
+  /// Set dyaw for each primitive
+  void setDyaw(decimal_t dyaw) {
+    ENV_->set_dyaw(dyaw);
+    if (planner_verbose_)
+      printf("[PlannerBase] set dyaw: %f\n", dyaw);
+  }
   /// Set weight for cost in time
   void setW(decimal_t w) {
     ENV_->set_w(w);
@@ -262,6 +329,34 @@ public:
     if (planner_verbose_)
       printf("[PlannerBase] set max num: %d\n", max_num_);
   }
+  /**
+   * @brief Set the memory budget of A*
+   * @param max_states maximum number of states, 0 means no limitation
+   * @param max_bytes maximum bytes of the state space, 0 means no limitation
+   *
+   * Beyond the budget, states that are no other state's best predecessor are
+   * evicted, the closed ones first, then the open ones with the worst f. Those
+   * are regenerated one at a time from their parents if needed (SMA*). LPA*
+   * ignores the budget.
+   */
+  void setMemoryBudget(size_t max_states, size_t max_bytes = 0) {
+    max_states_ = max_states;
+    max_bytes_ = max_bytes;
+    if (planner_verbose_)
+      printf("[PlannerBase] set memory budget: %zu states, %zu bytes\n",
+             max_states_, max_bytes_);
+  }
+  /// Get number of states evicted by the memory budget
+  int getEvictedNum() const {
+    return ss_ptr_ ? ss_ptr_->evicted_num_ : 0;
+  }
+  /// Set the number of expansions between two samples of the peak memory
+  void setMemorySampleInterval(int num) {
+    memory_sample_interval_ = num;
+    if (planner_verbose_)
+      printf("[PlannerBase] set memory sample interval: %d\n",
+             memory_sample_interval_);
+  }
   /// Set U
   void setU(const vec_E<VecDf> &U) {
     ENV_->set_u(U);
@@ -273,14 +368,17 @@ public:
       printf("[PlannerBase] set prior trajectory\n");
   }
   /// Set tolerance in geometric and dynamic spaces
-  void setTol(decimal_t tol_dis, decimal_t tol_vel = 0, decimal_t tol_acc = 0) {
+  void setTol(decimal_t tol_dis, decimal_t tol_vel = 0, decimal_t tol_acc = 0,
+              decimal_t tol_yaw = 0) {
     ENV_->set_tol_dis(tol_dis);
     ENV_->set_tol_vel(tol_vel);
     ENV_->set_tol_acc(tol_acc);
+    ENV_->set_tol_yaw(tol_yaw);
     if (planner_verbose_) {
       printf("[PlannerBase] set tol_dis: %f\n", tol_dis);
       printf("[PlannerBase] set tol_vel: %f\n", tol_vel);
       printf("[PlannerBase] set tol_acc: %f\n", tol_acc);
+      printf("[PlannerBase] set tol_yaw: %f\n", tol_yaw);
     }
   }
   /**
@@ -292,6 +390,10 @@ public:
    * the trajectory hits the exact goal state due to discretization
    */
   bool plan(const Coord &start, const Coord &goal) {   
+    MPL_TRACE_SCOPE("PlannerBase::plan");
+    const auto t0 = std::chrono::steady_clock::now();
+    partial_ = false;
+    cancelled_ = false;
    // std::cout <<"ggg"<<std::endl;
     if (planner_verbose_) {
       start.print("Start:");
@@ -300,6 +402,8 @@ public:
       ENV_->info();
     }
 
+    search_stats_.reset();
+    MPL_STATS_COLLECT(&search_stats_);
 
     if (!ENV_->is_free(start.pos)) {
       printf(ANSI_COLOR_RED "[PlannerBase] start is not free!"
@@ -310,6 +414,10 @@ public:
 
     std::unique_ptr<MPL::GraphSearch<Dim, Coord>> planner_ptr(
       new MPL::GraphSearch<Dim, Coord>(planner_verbose_));
+    if (timeout_us_ > 0)
+      planner_ptr->setDeadline(t0 + std::chrono::microseconds(timeout_us_));
+    planner_ptr->setCancelFlag(cancel_);
+    planner_ptr->setProgress(progress_);
 
     // If use A*, reset the state space
     if (!use_lpastar_)
@@ -326,18 +434,27 @@ public:
 
     ENV_->set_goal(goal);
 
-    ENV_->expanded_nodes_.clear();
-
     ss_ptr_->dt_ = ENV_->get_dt();
+    ss_ptr_->memory_sample_interval_ = memory_sample_interval_;
+    ss_ptr_->max_states_ = max_states_;
+    ss_ptr_->max_bytes_ = max_bytes_;
     if (use_lpastar_)
       planner_ptr->LPAstar(start, ENV_->state_to_idx(start), ENV_, ss_ptr_, traj_,
                            max_num_, max_t_);
     else
       if(!planner_ptr->Astar(start, ENV_->state_to_idx(start), ENV_, ss_ptr_, traj_,
                          max_num_, max_t_)){
+        partial_ = planner_ptr->partial();
+        cancelled_ = planner_ptr->cancelled();
         return false;
       }
 
+    if (planner_ptr->partial() || planner_ptr->cancelled()) {
+      partial_ = planner_ptr->partial();
+      cancelled_ = planner_ptr->cancelled();
+      return false;
+    }
+
     if (traj_.segs.empty()) {
       if (planner_verbose_)
         printf(ANSI_COLOR_RED "[MPPlanner] Cannot find a traj!" ANSI_COLOR_RESET
@@ -368,10 +485,28 @@ protected:
   int max_num_ = -1;
   /// Maxmum time horizon of expansion, 0 means no limitation
   decimal_t max_t_ = 0;
+  /// Number of expansions between two samples of the memory, 0 means no sample
+  int memory_sample_interval_ = 0;
+  /// Deadline of each plan in microseconds, 0 means no limitation
+  long timeout_us_ = 0;
+  /// Set if the last plan was stopped by the deadline
+  bool partial_ = false;
+  /// Flag polled to cancel the plan, can be null
+  const std::atomic<bool> *cancel_ = nullptr;
+  /// Set if the last plan was cancelled
+  bool cancelled_ = false;
+  /// Progress of the running plan, can be null
+  SearchProgress *progress_ = nullptr;
+  /// Maximum number of states of A*, 0 means no limitation
+  size_t max_states_ = 0;
+  /// Maximum bytes of the state space of A*, 0 means no limitation
+  size_t max_bytes_ = 0;
   /// Enable LPAstar for planning
   bool use_lpastar_ = false;
   /// Enabled to display debug message
   bool planner_verbose_;
+  /// Counters of the last plan
+  SearchStats search_stats_;
 };
 }
 
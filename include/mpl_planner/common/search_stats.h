@@ -0,0 +1,220 @@
+/**
+ * @file search_stats.h
+ * @brief per-phase counters and timers of the graph search
+ *
+ * The instrumentation is compiled only if `MPL_SEARCH_STATS` is defined (cmake
+ * option `MPL_SEARCH_STATS`), otherwise the `MPL_STATS_*` macros expand to
+ * nothing and `SearchStats` stays zero.
+ */
+#ifndef MPL_SEARCH_STATS_H
+#define MPL_SEARCH_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace MPL {
+
+/**
+ * @brief Counters of one search
+ *
+ * Each phase holds the number of calls and the cumulative ticks spent in them,
+ * a tick is a TSC cycle on x86 and a nanosecond elsewhere. Timers of nested
+ * phases are inclusive, e.g. `get_succ` contains `validate` and `collision`.
+ */
+struct SearchStats {
+  /// Whether the instrumentation is compiled in
+#ifdef MPL_SEARCH_STATS
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+
+  /// Number of calls and cumulative ticks of a phase
+  struct Phase {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+    /// Average ticks per call
+    double avg() const { return count ? (double) ticks / count : 0; }
+  };
+
+  /// Push into the open set
+  Phase heap_push;
+  /// Pop from the open set
+  Phase heap_pop;
+  /// Decrease key or erase in the open set
+  Phase heap_update;
+  /// Lookup in the hashmap
+  Phase hash_lookup;
+  /// Creation of a new node in the hashmap
+  Phase hash_insert;
+  /// Successor generation, `env_base::get_succ`
+  Phase get_succ;
+  /// Dynamic constraints check of a primitive
+  Phase validate;
+  /// Collision checking of a primitive
+  Phase collision;
+  /// Heuristic evaluation, counted per state
+  Phase heuristic;
+  /// Trajectory recovery
+  Phase recover;
+
+  /// Number of primitives generated per action id
+  std::vector<uint64_t> action_num;
+  /// Number of primitives violating the dynamic constraints per action id
+  std::vector<uint64_t> action_dynamics_reject;
+  /// Number of primitives in collision per action id
+  std::vector<uint64_t> action_collision_reject;
+
+  /// Clear all the counters
+  void reset() { *this = SearchStats(); }
+
+  /// Record the outcome of the primitive generated by the action `id`
+  void add_action(int id, bool dynamics_ok, bool collision_free) {
+    if (id < 0)
+      return;
+    if ((size_t) id >= action_num.size()) {
+      action_num.resize(id + 1, 0);
+      action_dynamics_reject.resize(id + 1, 0);
+      action_collision_reject.resize(id + 1, 0);
+    }
+    action_num[id]++;
+    if (!dynamics_ok)
+      action_dynamics_reject[id]++;
+    else if (!collision_free)
+      action_collision_reject[id]++;
+  }
+
+  /// Ratio of primitives of the action `id` rejected by dynamic constraints
+  double dynamics_reject_rate(int id) const {
+    return id >= 0 && (size_t) id < action_num.size() && action_num[id]
+               ? (double) action_dynamics_reject[id] / action_num[id]
+               : 0;
+  }
+
+  /// Ratio of dynamically feasible primitives of the action `id` in collision
+  double collision_reject_rate(int id) const {
+    if (id < 0 || (size_t) id >= action_num.size())
+      return 0;
+    const uint64_t n = action_num[id] - action_dynamics_reject[id];
+    return n ? (double) action_collision_reject[id] / n : 0;
+  }
+
+  /// Print the counters
+  void print() const {
+    const std::pair<const char *, const Phase *> phases[] = {
+        {"heap_push", &heap_push},     {"heap_pop", &heap_pop},
+        {"heap_update", &heap_update}, {"hash_lookup", &hash_lookup},
+        {"hash_insert", &hash_insert}, {"get_succ", &get_succ},
+        {"validate", &validate},       {"collision", &collision},
+        {"heuristic", &heuristic},     {"recover", &recover}};
+    printf("%-12s %12s %14s %10s\n", "phase", "count", "ticks", "avg");
+    for (const auto &it : phases)
+      printf("%-12s %12lu %14lu %10.1f\n", it.first,
+             (unsigned long) it.second->count,
+             (unsigned long) it.second->ticks, it.second->avg());
+    for (size_t i = 0; i < action_num.size(); i++)
+      printf("action %2zu: num %8lu, dynamics reject %.3f, collision reject "
+             "%.3f\n",
+             i, (unsigned long) action_num[i], dynamics_reject_rate(i),
+             collision_reject_rate(i));
+  }
+
+  /// Stats collected by the search running on this thread, can be null
+  static SearchStats *&current() {
+    static thread_local SearchStats *stats = nullptr;
+    return stats;
+  }
+
+  /// Read the tick counter
+  static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+};
+
+/// Route the stats of the searches on this thread into `stats` in a scope
+class SearchStatsScope {
+public:
+  explicit SearchStatsScope(SearchStats *stats)
+      : prev_(SearchStats::current()) {
+    SearchStats::current() = stats;
+  }
+  ~SearchStatsScope() { SearchStats::current() = prev_; }
+  SearchStatsScope(const SearchStatsScope &) = delete;
+  SearchStatsScope &operator=(const SearchStatsScope &) = delete;
+
+private:
+  SearchStats *prev_;
+};
+
+/// Count a call of a phase and accumulate the ticks spent in the scope
+class PhaseTimer {
+public:
+  explicit PhaseTimer(SearchStats::Phase SearchStats::*phase, uint64_t n = 1)
+      : stats_(SearchStats::current()), phase_(phase), n_(n),
+        start_(stats_ ? SearchStats::ticks() : 0) {}
+  ~PhaseTimer() {
+    if (stats_) {
+      SearchStats::Phase &p = stats_->*phase_;
+      p.count += n_;
+      p.ticks += SearchStats::ticks() - start_;
+    }
+  }
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  SearchStats *stats_;
+  SearchStats::Phase SearchStats::*phase_;
+  uint64_t n_;
+  uint64_t start_;
+};
+}
+
+#define MPL_STATS_CAT_(a, b) a##b
+#define MPL_STATS_CAT(a, b) MPL_STATS_CAT_(a, b)
+
+#ifdef MPL_SEARCH_STATS
+/// Collect the stats of the searches in the current scope into `stats`
+#define MPL_STATS_COLLECT(stats)                                               \
+  MPL::SearchStatsScope MPL_STATS_CAT(mpl_stats_scope_, __LINE__)(stats)
+/// Time the rest of the current scope as `n` calls of `phase`
+#define MPL_STATS_SCOPE_N(phase, n)                                            \
+  MPL::PhaseTimer MPL_STATS_CAT(mpl_stats_timer_, __LINE__)(                   \
+      &MPL::SearchStats::phase, n)
+/// Time the statement as a call of `phase`
+#define MPL_STATS_TIME(phase, ...)                                             \
+  do {                                                                         \
+    MPL::PhaseTimer mpl_stats_timer_(&MPL::SearchStats::phase);                \
+    __VA_ARGS__;                                                               \
+  } while (0)
+/// Record the outcome of the primitive generated by the action `id`
+#define MPL_STATS_ACTION(id, dynamics_ok, collision_free)                      \
+  do {                                                                         \
+    if (MPL::SearchStats *mpl_stats_ = MPL::SearchStats::current())            \
+      mpl_stats_->add_action(id, dynamics_ok, collision_free);                 \
+  } while (0)
+#else
+#define MPL_STATS_COLLECT(stats)
+#define MPL_STATS_SCOPE_N(phase, n)
+#define MPL_STATS_TIME(phase, ...)                                             \
+  do {                                                                         \
+    __VA_ARGS__;                                                               \
+  } while (0)
+#define MPL_STATS_ACTION(id, dynamics_ok, collision_free)
+#endif
+
+/// Time the rest of the current scope as a call of `phase`
+#define MPL_STATS_SCOPE(phase) MPL_STATS_SCOPE_N(phase, 1)
+
+#endif
@@ -5,9 +5,11 @@
 #ifndef MPL_STATE_SPACE_H
 #define MPL_STATE_SPACE_H
 
+#include <algorithm> // std::nth_element
 #include <boost/heap/d_ary_heap.hpp> // boost::heap::d_ary_heap
 #include <mpl_planner/common/env_base.h>
 #include <unordered_map> // std::unordered_map
+#include <unordered_set> // std::unordered_set
 
 namespace MPL {
 /// Heap element comparison
@@ -66,6 +68,10 @@ template <typename Coord> struct State {
   bool iterationopened = false;
   /// label check if the state has been closed
   bool iterationclosed = false;
+  /// hashkey of successors forgotten by the memory budget, tracked by A*
+  std::vector<Key> forgotten_hashkey;
+  /// backed up fval of forgotten successors
+  std::vector<decimal_t> forgotten_fval;
 
   /// Simple constructor
   State(Key hashkey, const Coord& coord)
@@ -78,6 +84,71 @@ template <typename Coord> using StatePtr = std::shared_ptr<State<Coord>>;
 /// Define hashmap type
 template <typename Coord> using hashMap = std::unordered_map<Key, StatePtr<Coord>>;
 
+/**
+ * @brief Memory used by the state space
+ *
+ * The bytes are estimated from the sizes and capacities of the containers
+ * with the node layouts of libstdc++ and boost::heap, allocator overheads are
+ * not included.
+ */
+struct StateSpaceMemory {
+  /// Number of states in the hashmap
+  size_t states = 0;
+  /// Number of states in the open set
+  size_t open_states = 0;
+  /// Number of stored successor edges
+  size_t succ_edges = 0;
+  /// Number of stored predecessor edges
+  size_t pred_edges = 0;
+  /// Number of buckets of the hashmap
+  size_t buckets = 0;
+  /// Load factor of the hashmap
+  float load_factor = 0;
+  /// Bytes of the `State` objects, their control blocks and hashkeys
+  size_t state_bytes = 0;
+  /// Bytes of the successor arrays
+  size_t succ_bytes = 0;
+  /// Bytes of the predecessor arrays
+  size_t pred_bytes = 0;
+  /// Bytes of the hashmap buckets and nodes, including the keys
+  size_t hash_bytes = 0;
+  /// Bytes of the open set
+  size_t heap_bytes = 0;
+  /// Largest total bytes sampled since the state space was created
+  size_t peak_bytes = 0;
+
+  /// Total bytes
+  size_t total() const {
+    return state_bytes + succ_bytes + pred_bytes + hash_bytes + heap_bytes;
+  }
+  /// Average bytes per state
+  double bytes_per_state() const {
+    return states ? (double) total() / states : 0;
+  }
+  /// Print the break down
+  void print() const {
+    printf("states: %zu (open %zu), edges: succ %zu, pred %zu, buckets: %zu, "
+           "load factor: %.3f\n",
+           states, open_states, succ_edges, pred_edges, buckets, load_factor);
+    printf("bytes: state %zu, succ %zu, pred %zu, hash %zu, heap %zu, total %zu "
+           "(%.1f per state), peak %zu\n",
+           state_bytes, succ_bytes, pred_bytes, hash_bytes, heap_bytes, total(),
+           bytes_per_state(), peak_bytes);
+  }
+};
+
+/// Heap bytes of the key, zero if it fits in the small string buffer
+inline size_t key_bytes(const Key &key) {
+  static const size_t sso_capacity = Key().capacity();
+  return key.capacity() > sso_capacity ? key.capacity() + 1 : 0;
+}
+
+/// Bytes of the elements of the vector
+template <typename T, typename A>
+size_t vector_bytes(const std::vector<T, A> &v) {
+  return v.capacity() * sizeof(T);
+}
+
 /// State space
 template <int Dim, typename Coord> struct StateSpace {
   /// Priority queue, open set
@@ -94,6 +165,18 @@ template <int Dim, typename Coord> struct StateSpace {
   decimal_t max_t_ = std::numeric_limits<decimal_t>::infinity();
   /// Number of expansion iteration
   int expand_iteration_ = 0;
+  /// Number of expansions between two samples of the memory, 0 means no sample
+  int memory_sample_interval_ = 0;
+  /// Largest memory sampled, in bytes
+  size_t peak_bytes_ = 0;
+  /// Maximum number of states kept by A*, 0 means no limitation
+  size_t max_states_ = 0;
+  /// Maximum bytes kept by A*, 0 means no limitation
+  size_t max_bytes_ = 0;
+  /// Number of states evicted to satisfy the budget
+  int evicted_num_ = 0;
+  /// Bytes per state of the last memory estimate, used for the byte budget
+  double bytes_per_state_ = 0;
 
   /// Simple constructor
   StateSpace(decimal_t eps = 1) : eps_(eps) {}
@@ -103,8 +186,11 @@ template <int Dim, typename Coord> struct StateSpace {
    * @param time_step indicates the root of the subtree (best_child_[time_step])
   */
   void getSubStateSpace(int time_step) {
+    MPL_TRACE_SCOPE("StateSpace::getSubStateSpace");
     if (best_child_.empty())
       return;
+    // keep the peak of the previous plan before pruning
+    sampleMemory();
 
     StatePtr<Coord> currNode_ptr = best_child_[time_step];
     currNode_ptr->pred_action_cost.clear();
@@ -260,18 +346,18 @@ template <int Dim, typename Coord> struct StateSpace {
       currNode_ptr->rhs = std::numeric_limits<decimal_t>::infinity();
       for (unsigned int i = 0; i < currNode_ptr->pred_hashkey.size(); i++) {
         Key pred_key = currNode_ptr->pred_hashkey[i];
-        if (currNode_ptr->rhs >
-            hm_[pred_key]->g + currNode_ptr->pred_action_cost[i]) {
-          currNode_ptr->rhs =
-            hm_[pred_key]->g + currNode_ptr->pred_action_cost[i];
-          currNode_ptr->coord.t = hm_[pred_key]->coord.t + dt_;
+        const State<Coord> *pred_ptr;
+        MPL_STATS_TIME(hash_lookup, pred_ptr = hm_[pred_key].get());
+        if (currNode_ptr->rhs > pred_ptr->g + currNode_ptr->pred_action_cost[i]) {
+          currNode_ptr->rhs = pred_ptr->g + currNode_ptr->pred_action_cost[i];
+          currNode_ptr->coord.t = pred_ptr->coord.t + dt_;
         }
       }
     }
 
     // if currNode is in openset, remove it
     if (currNode_ptr->iterationopened && !currNode_ptr->iterationclosed) {
-      pq_.erase(currNode_ptr->heapkey);
+      MPL_STATS_TIME(heap_update, pq_.erase(currNode_ptr->heapkey));
       currNode_ptr->iterationclosed = true;
     }
 
@@ -280,13 +366,193 @@ template <int Dim, typename Coord> struct StateSpace {
     // {
     if (currNode_ptr->g != currNode_ptr->rhs) {
       decimal_t fval = calculateKey(currNode_ptr);
-      currNode_ptr->heapkey = pq_.push(std::make_pair(fval, currNode_ptr));
+      MPL_STATS_TIME(heap_push, currNode_ptr->heapkey =
+                                    pq_.push(std::make_pair(fval, currNode_ptr)));
       currNode_ptr->iterationopened = true;
       currNode_ptr->iterationclosed = false;
     }
   }
 
 
+  /// Estimate the memory used by the state space
+  StateSpaceMemory memory() const {
+    StateSpaceMemory m;
+    m.states = hm_.size();
+    m.open_states = pq_.size();
+    m.buckets = hm_.bucket_count();
+    m.load_factor = hm_.load_factor();
+    // make_shared allocates the use and weak counts with the vtable pointer
+    const size_t state_size = sizeof(State<Coord>) + 2 * sizeof(void *);
+    // libstdc++ nodes hold the next pointer and the cached hash of the key
+    const size_t hash_node_size = sizeof(typename hashMap<Coord>::value_type) +
+                                  sizeof(void *) + sizeof(size_t);
+    m.hash_bytes = m.buckets * sizeof(void *) + m.states * hash_node_size;
+    for (const auto &it : hm_) {
+      m.hash_bytes += key_bytes(it.first);
+      const StatePtr<Coord> &s = it.second;
+      if (!s)
+        continue;
+      m.state_bytes += state_size + key_bytes(s->hashkey) +
+                       vector_bytes(s->forgotten_hashkey) +
+                       vector_bytes(s->forgotten_fval);
+      for (const auto &key : s->forgotten_hashkey)
+        m.state_bytes += key_bytes(key);
+      m.succ_edges += s->succ_hashkey.size();
+      m.succ_bytes += vector_bytes(s->succ_coord) +
+                      vector_bytes(s->succ_hashkey) +
+                      vector_bytes(s->succ_action_id) +
+                      vector_bytes(s->succ_action_cost);
+      for (const auto &key : s->succ_hashkey)
+        m.succ_bytes += key_bytes(key);
+      m.pred_edges += s->pred_hashkey.size();
+      m.pred_bytes += vector_bytes(s->pred_hashkey) +
+                      vector_bytes(s->pred_action_id) +
+                      vector_bytes(s->pred_action_cost);
+      for (const auto &key : s->pred_hashkey)
+        m.pred_bytes += key_bytes(key);
+    }
+    // the mutable d-ary heap keeps its values in a list indexed by a vector
+    m.heap_bytes = m.open_states *
+                   (sizeof(typename priorityQueue<State<Coord>>::value_type) +
+                    sizeof(size_t) + 3 * sizeof(void *));
+    m.peak_bytes = std::max(peak_bytes_, m.total());
+    return m;
+  }
+
+  /// Sample the memory to update the peak
+  void sampleMemory() {
+    peak_bytes_ = std::max(peak_bytes_, memory().total());
+  }
+
+  /**
+   * @brief Check if the states exceed `max_states_` or `max_bytes_`
+   *
+   * The bytes are extrapolated from the last estimate and only recomputed
+   * when the extrapolation exceeds the budget.
+   */
+  bool overBudget() {
+    if (max_states_ > 0 && hm_.size() > max_states_)
+      return true;
+    if (max_bytes_ == 0 ||
+        (bytes_per_state_ > 0 && hm_.size() * bytes_per_state_ <= max_bytes_))
+      return false;
+    const StateSpaceMemory m = memory();
+    peak_bytes_ = m.peak_bytes;
+    bytes_per_state_ = m.bytes_per_state();
+    return m.total() > max_bytes_;
+  }
+
+  /**
+   * @brief Forget leaves until the budget is met with some margin
+   *
+   * As in SMA*, a leaf is a state that is not the best predecessor of any
+   * other state. Closed leaves are forgotten first: their successors are
+   * reached as cheaply from other states. Then open leaves are forgotten in
+   * decreasing order of f, and the f of each one is backed up into its best
+   * predecessor. That predecessor remembers the forgotten child and is
+   * re-opened with this value, so the leaf is regenerated once its f becomes
+   * the best again. Only A* keeps the forgotten children.
+   */
+  void evict() {
+    // evict below the budget so that the next eviction is not immediate
+    const decimal_t margin = 0.9;
+    size_t target = std::numeric_limits<size_t>::max();
+    if (max_states_ > 0)
+      target = margin * max_states_;
+    if (max_bytes_ > 0 && bytes_per_state_ > 0)
+      target = std::min<size_t>(target, margin * max_bytes_ / bytes_per_state_);
+
+    // leaves sorted by closed first, then by the lowest g or the highest f
+    typedef std::pair<std::pair<bool, decimal_t>, StatePtr<Coord>> Leaf;
+    std::vector<Leaf> leaves;
+    std::unordered_set<const State<Coord> *> parents;
+    while (hm_.size() > target) {
+      parents.clear();
+      for (const auto &it : hm_) {
+        const State<Coord> *parent = bestPred(*it.second);
+        if (parent)
+          parents.insert(parent);
+      }
+      leaves.clear();
+      for (const auto &it : hm_) {
+        const StatePtr<Coord> &node = it.second;
+        if (node->pred_hashkey.empty() || parents.count(node.get()))
+          continue;
+        if (node->iterationclosed)
+          leaves.push_back(Leaf(std::make_pair(false, node->g), node));
+        else
+          leaves.push_back(Leaf(std::make_pair(true, -(*node->heapkey).first), node));
+      }
+      if (leaves.empty())
+        break;
+      const size_t n = std::min(leaves.size(), hm_.size() - target);
+      std::nth_element(leaves.begin(), leaves.begin() + n - 1, leaves.end(),
+                       [](const Leaf &a, const Leaf &b) {
+                         return a.first < b.first;
+                       });
+      for (size_t i = 0; i < n; i++)
+        evictLeaf(leaves[i].second);
+    }
+
+    if (max_bytes_ > 0)
+      bytes_per_state_ = memory().bytes_per_state();
+  }
+
+  /// Remove the leaf from the graph, back up its f if it is open
+  void evictLeaf(const StatePtr<Coord> &leaf) {
+    if (!leaf->iterationclosed) {
+      const decimal_t fval = (*leaf->heapkey).first;
+      pq_.erase(leaf->heapkey);
+      State<Coord> *parent = bestPred(*leaf);
+      if (parent) {
+        parent->forgotten_hashkey.push_back(leaf->hashkey);
+        parent->forgotten_fval.push_back(fval);
+        reopen(hm_[parent->hashkey], fval);
+      }
+    }
+    hm_.erase(leaf->hashkey);
+    evicted_num_++;
+  }
+
+  /// Predecessor in the hashmap with the lowest g plus action cost
+  State<Coord> *bestPred(const State<Coord> &node) const {
+    State<Coord> *best_parent = nullptr;
+    decimal_t best_g = std::numeric_limits<decimal_t>::infinity();
+    for (unsigned int i = 0; i < node.pred_hashkey.size(); i++) {
+      auto search = hm_.find(node.pred_hashkey[i]);
+      if (search == hm_.end())
+        continue;
+      State<Coord> *parent = search->second.get();
+      if (!best_parent || parent->g + node.pred_action_cost[i] < best_g) {
+        best_parent = parent;
+        best_g = parent->g + node.pred_action_cost[i];
+      }
+    }
+    return best_parent;
+  }
+
+  /// Take the forgotten child with the lowest f out of the state
+  Key popForgotten(State<Coord> &node) {
+    const size_t id = std::min_element(node.forgotten_fval.begin(),
+                                       node.forgotten_fval.end()) -
+                      node.forgotten_fval.begin();
+    const Key key = node.forgotten_hashkey[id];
+    node.forgotten_hashkey.erase(node.forgotten_hashkey.begin() + id);
+    node.forgotten_fval.erase(node.forgotten_fval.begin() + id);
+    return key;
+  }
+
+  /// Open the state with the given fval, or lower its fval if already open
+  void reopen(const StatePtr<Coord> &node, decimal_t fval) {
+    if (node->iterationclosed) {
+      node->iterationclosed = false;
+      node->heapkey = pq_.push(std::make_pair(fval, node));
+    } else if (fval < (*node->heapkey).first) {
+      (*node->heapkey).first = fval;
+      pq_.increase(node->heapkey);
+    }
+  }
+
   /// Calculate the fval as min(rhs, g) + h
   decimal_t calculateKey(const StatePtr<Coord> &node) {
     return std::min(node->g, node->rhs) + eps_ * node->h;
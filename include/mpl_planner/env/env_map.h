@@ -16,8 +16,13 @@ namespace MPL {
  */
 template <int Dim> class env_map : public env_base<Dim> {
 public:
-  /// Constructor with map util as input
-  env_map(std::shared_ptr<MapUtil<Dim>> map_util) : map_util_(map_util) {}
+  /**
+   * @brief Constructor with map util as input
+   *
+   * The map util is only read, one map can be shared by the environments of
+   * planners running on different threads
+   */
+  env_map(std::shared_ptr<const MapUtil<Dim>> map_util) : map_util_(map_util) {}
 
   /// Check if state hit the goal region, use L-1 norm
   bool is_goal(const Waypoint<Dim> &state) const {
@@ -31,17 +36,56 @@ public:
     if (goaled) {
       auto pns = map_util_->rayTrace(state.pos, this->goal_node_.pos);
       for (const auto &it : pns) {
-        if (map_util_->isOccupied(it))
+        if (is_occupied(it, state))
           return false;
       }
     }
     return goaled;
   }
 
-  /// Check if a point is in free space
+  /**
+   * @brief Check if a point is in free space
+   *
+   * Yaw is unknown here, so only the inscribed circle of the footprint is
+   * checked if the footprint is set
+   */
   bool is_free(const Vecf<Dim> &pt) const {
     const auto pn = map_util_->floatToInt(pt);
-    return map_util_->isFree(pn);
+    return map_util_->isFree(pn, footprint_masks_.empty() ? robot_r_ : footprint_r_in_);
+  }
+
+  /**
+   * @brief Check if the robot at cell pn collides with any occupied cell
+   * @param yaw the yaw at pn, used only if use_yaw is true
+   *
+   * Without footprint, the cell is checked against the robot radius.
+   * Otherwise, the clearance of pn decides directly when the circumscribed
+   * circle is free or the inscribed circle is not; only the rest goes through
+   * the footprint mask of the closest yaw. A waypoint without yaw is checked
+   * against the circumscribed circle, which covers every heading.
+   */
+  bool is_occupied(const Veci<Dim> &pn, decimal_t yaw, bool use_yaw) const {
+    if (footprint_masks_.empty())
+      return map_util_->isOccupied(pn, robot_r_);
+    if (!map_util_->isOccupied(pn, footprint_r_out_))
+      return false;
+    if (!use_yaw ||
+        (footprint_r_in_ > 0 && map_util_->isOccupied(pn, footprint_r_in_)))
+      return true;
+    const int n = footprint_masks_.size();
+    int id = std::round(normalize_angle(yaw) * n / (2 * M_PI));
+    id = (id % n + n) % n;
+    for (const auto &it : footprint_masks_[id]) {
+      const Veci<Dim> new_pn = pn + it;
+      if (map_util_->isOccupied(new_pn))
+        return true;
+    }
+    return false;
+  }
+
+  /// Check if the robot at cell pn collides with any occupied cell, use the yaw of pt if `pt.use_yaw` is true
+  bool is_occupied(const Veci<Dim> &pn, const Waypoint<Dim> &pt) const {
+    return is_occupied(pn, pt.yaw, pt.use_yaw);
   }
 
   /**
@@ -49,27 +93,92 @@ public:
    *
    * Sample points along the primitive, and check each point for collision; the
    * number of sampling is calculated based on the maximum velocity and
-   * resolution of the map.
+   * resolution of the map. If the robot radius is set, each point is checked
+   * against the clearance layer of the map.
+   *
+   * If the clearance layer exists, the samples inside a sub-interval whose
+   * bounding box is certified free by `is_free_bound()` are skipped, so are
+   * the samples within `free_duration()` after a free sample.
    */
   bool is_free(const Primitive<Dim> &pr) const {
     decimal_t max_v = 0;
-    for (int i = 0; i < Dim; i++) {
-      if (pr.max_vel(i) > max_v)
-        max_v = pr.max_vel(i);
-    }
+    for (int i = 0; i < Dim; i++)
+      max_v = std::max(max_v, pr.max_vel(i));
     int n = std::ceil(max_v * pr.t() / map_util_->getRes());
-    vec_E<Waypoint<Dim>> pts = pr.sample(n);
-    for (const auto &pt : pts) {
-      Veci<Dim> pn = map_util_->floatToInt(pt.pos);
-      if (map_util_->isOccupied(pn) || map_util_->isOutside(pn))
+    const bool use_clearance =
+      map_util_->hasClearance() && this->valid_region_.empty();
+    const decimal_t max_speed = max_v * std::sqrt((decimal_t)Dim);
+    const bool use_yaw =
+      !footprint_masks_.empty() && Waypoint<Dim>(pr.control()).use_yaw;
+    decimal_t dt = pr.t() / n;
+    decimal_t span = pr.t();
+    decimal_t free_t = -1;
+    for (int i = 0; i <= n; i++) {
+      const decimal_t t = i * dt;
+      if (t <= free_t)
+        continue;
+      if (use_clearance && span >= 2 * dt) {
+        if (is_free_bound(pr, t, std::min(t + span, pr.t()))) {
+          free_t = t + span;
+          // try the rest of the primitive next
+          span = pr.t() - free_t;
+          continue;
+        }
+        span /= 2;
+      }
+      Veci<Dim> pn = map_util_->floatToInt(pr.evaluate_pos(t));
+      if (is_occupied(pn, use_yaw ? pr.evaluate_yaw(t) : 0, use_yaw) ||
+          map_util_->isOutside(pn))
         return false;
       if(!this->valid_region_.empty() && !this->valid_region_[map_util_->getIndex(pn)])
         return false;
+      if (use_clearance)
+        free_t = t + free_duration(pn, max_speed);
     }
 
     return true;
   }
 
+  /**
+   * @brief Check if the primitive is certified free over \f$[t_1, t_2]\f$
+   *
+   * The bounding box from `Primitive::bound()` is compared against the
+   * clearance of the cell at its center. It is conservative, false means
+   * the result is inconclusive rather than in collision.
+   */
+  bool is_free_bound(const Primitive<Dim> &pr, decimal_t t1, decimal_t t2) const {
+    Vecf<Dim> lo, hi;
+    pr.bound(t1, t2, lo, hi);
+    if (map_util_->isOutside(map_util_->floatToInt(lo)) ||
+        map_util_->isOutside(map_util_->floatToInt(hi)))
+      return false;
+    const Veci<Dim> pn = map_util_->floatToInt((lo + hi) / 2);
+    const Vecf<Dim> pc = map_util_->intToFloat(pn);
+    // distance from the center cell to the farthest cell that a point in the box falls in
+    const decimal_t d =
+      (lo - pc).cwiseAbs().cwiseMax((hi - pc).cwiseAbs()).norm() +
+      map_util_->getRes() * std::sqrt((decimal_t)Dim) / 2;
+    return map_util_->getClearance(pn) - d > collision_radius();
+  }
+
+  /**
+   * @brief Duration that is certified free after passing the free cell pn
+   * @param speed the max speed of the primitive
+   *
+   * Any point within the clearance of pn, subtracted by the robot radius and
+   * the cell diagonal, falls in a free cell inside the map; the time to leave
+   * this ball bounds the next time step, which stays the same as uniform
+   * sampling near obstacles
+   */
+  decimal_t free_duration(const Veci<Dim> &pn, decimal_t speed) const {
+    decimal_t d = map_util_->getClearance(pn) - collision_radius() -
+      map_util_->getRes() * std::sqrt((decimal_t)Dim);
+    const Veci<Dim> dim = map_util_->getDim();
+    for (int i = 0; i < Dim; i++)
+      d = std::min(d, map_util_->getRes() * std::min(pn(i), dim(i) - 1 - pn(i)));
+    return d > 0 ? d / speed : 0;
+  }
+
  /**
    * @brief Accumulate the cost along the primitive
    *
@@ -79,21 +188,52 @@ public:
    *
    * If the potential map has been set, it also uses the potential values;
    * otherwise, the accumulated value will be zero for collision-free primitive
-   * and infinity for others.
+   * and infinity for others. In the latter case, the samples certified free by
+   * `is_free_bound()` and `free_duration()` are skipped as in `is_free()`.
    */
 
   decimal_t traverse_primitive(const Primitive<Dim> &pr) const {
     decimal_t max_v = 0;
-    for (int i = 0; i < Dim; i++) {
-      if (pr.max_vel(i) > max_v)
-        max_v = pr.max_vel(i);
-    }
+    for (int i = 0; i < Dim; i++)
+      max_v = std::max(max_v, pr.max_vel(i));
     int n = std::max(5, (int)std::ceil(max_v * pr.t() / map_util_->getRes()));
     decimal_t c = 0;
+    const bool use_yaw = Waypoint<Dim>(pr.control()).use_yaw;
+    // the full state is only needed by the potential and yaw costs
+    const bool full_state =
+      !potential_map_.empty() || (this->wyaw_ > 0 && use_yaw);
+    const bool use_clearance = map_util_->hasClearance() &&
+      this->valid_region_.empty() && !full_state;
+    const decimal_t max_speed = max_v * std::sqrt((decimal_t)Dim);
+    decimal_t span = pr.t();
+    decimal_t free_t = -1;
 
     decimal_t dt = pr.t() / n;
     for (decimal_t t = 0; t < pr.t(); t += dt) {
-      const auto pt = pr.evaluate(t);
+      if (t <= free_t)
+        continue;
+      if (use_clearance && span >= 2 * dt) {
+        if (is_free_bound(pr, t, std::min(t + span, pr.t()))) {
+          free_t = t + span;
+          // try the rest of the primitive next
+          span = pr.t() - free_t;
+          continue;
+        }
+        span /= 2;
+      }
+      Waypoint<Dim> pt(pr.control());
+      if (full_state) {
+        pt = pr.evaluate(t);
+        // the costs below need the velocity even if the waypoints do not use it
+        if (!pt.use_vel)
+          pt.vel = pr.evaluate_vel(t);
+      }
+      else {
+        // only pos and yaw are read below
+        pt.pos = pr.evaluate_pos(t);
+        pt.vel = Vecf<Dim>::Zero();
+        pt.yaw = use_yaw && !footprint_masks_.empty() ? pr.evaluate_yaw(t) : 0;
+      }
       const Veci<Dim> pn = map_util_->floatToInt(pt.pos);
       const int idx = map_util_->getIndex(pn);
 
@@ -115,8 +255,10 @@ public:
         else if(potential_map_[idx] >= 100)
           return std::numeric_limits<decimal_t>::infinity();
       }
-      else if (map_util_->isOccupied(pn))
+      else if (is_occupied(pn, pt))
         return std::numeric_limits<decimal_t>::infinity();
+      if (use_clearance)
+        free_t = t + free_duration(pn, max_speed);
       if(this->wyaw_ > 0 && pt.use_yaw) {
         const auto v = pt.vel.template topRows<2>();
         if(v.norm() > 1e-5) { // if v is not zero
@@ -153,8 +295,6 @@ public:
     succ_cost.clear();
     action_idx.clear();
 
-    //this->expanded_nodes_.push_back(curr.pos);
-
     /*
     const Veci<Dim> pn = map_util_->floatToInt(curr.pos);
     if (map_util_->isOutside(pn))
@@ -164,14 +304,24 @@ public:
     for (unsigned int i = 0; i < this->U_.size(); i++) {
       Primitive<Dim> pr(curr, this->U_[i], this->dt_);
       Waypoint<Dim> tn = pr.evaluate(this->dt_);
-      if (tn == curr || !validate_primitive(pr, this->v_max_, this->a_max_,
-                                            this->j_max_, this->yaw_max_))
+      if (tn == curr)
         continue;
+      bool valid;
+      MPL_STATS_TIME(validate, valid = validate_primitive(
+                                   pr, this->v_max_, this->a_max_,
+                                   this->j_max_, this->yaw_max_));
+      if (!valid) {
+        MPL_STATS_ACTION(i, false, false);
+        continue;
+      }
       tn.t = curr.t + this->dt_;
       succ.push_back(tn);
       succ_idx.push_back(this->state_to_idx(tn));
       //std::cout << succ_idx.back() << std::endl;
-      decimal_t cost = curr.pos == tn.pos ? 0 : traverse_primitive(pr);
+      decimal_t cost = 0;
+      if (curr.pos != tn.pos)
+        MPL_STATS_TIME(collision, cost = traverse_primitive(pr));
+      MPL_STATS_ACTION(i, true, !std::isinf(cost));
       if (!std::isinf(cost))
         cost += pr.J(pr.control()) + this->w_ * this->dt_;
         //cost += pr.J(pr.control()) + this->wyaw_ * pr.Jyaw() + this->w_ * this->dt_;
@@ -201,29 +351,86 @@ public:
     potential_weight_ = w;
   }
 
+  /// Set robot radius, checked against the clearance layer of the map
+  void set_robot_radius(decimal_t r) {
+    robot_r_ = r;
+  }
+
+  /**
+   * @brief Set the polygon footprint of the robot in its body frame
+   * @param vertices vertices of the polygon in order, the origin is the
+   * position of the robot and the x-axis is its heading
+   *
+   * One mask of cell offsets is rasterized for each yaw bin at `dyaw_`
+   * resolution, a cell is in the mask if its center is inside the rotated
+   * polygon. For 3D map the footprint only spans the xy-plane of the cell.
+   * Call it after `set_dyaw()`, an empty polygon disables the footprint.
+   */
+  void set_footprint(const vec_Vec2f &vertices) {
+    footprint_masks_.clear();
+    footprint_r_in_ = 0;
+    footprint_r_out_ = 0;
+    if (vertices.size() < 3)
+      return;
+
+    const int m = vertices.size();
+    footprint_r_in_ = std::numeric_limits<decimal_t>::max();
+    for (int i = 0; i < m; i++) {
+      const Vec2f &p1 = vertices[i];
+      const Vec2f e = vertices[(i + 1) % m] - p1;
+      footprint_r_out_ = std::max(footprint_r_out_, p1.norm());
+      // distance from the origin to the edge
+      const decimal_t s = e.squaredNorm() > 0 ?
+        std::min<decimal_t>(1, std::max<decimal_t>(0, -p1.dot(e) / e.squaredNorm())) : 0;
+      footprint_r_in_ = std::min(footprint_r_in_, (p1 + s * e).norm());
+    }
+    if (!point_in_polygon(vertices, Vec2f::Zero()))
+      footprint_r_in_ = 0;
+
+    const decimal_t res = map_util_->getRes();
+    const int rn = std::ceil(footprint_r_out_ / res);
+    const int n = std::max(1, (int)std::ceil(2 * M_PI / this->dyaw_));
+    footprint_masks_.resize(n);
+    for (int k = 0; k < n; k++) {
+      const decimal_t yaw = 2 * M_PI * k / n;
+      Mat2f R;
+      R << cos(yaw), sin(yaw), -sin(yaw), cos(yaw);
+      Veci<Dim> offset = Veci<Dim>::Zero();
+      for (offset(0) = -rn; offset(0) <= rn; offset(0)++) {
+        for (offset(1) = -rn; offset(1) <= rn; offset(1)++) {
+          // cell center in the body frame
+          const Vec2f pt = R * (offset.template topRows<2>().template cast<decimal_t>() * res);
+          if (point_in_polygon(vertices, pt))
+            footprint_masks_[k].push_back(offset);
+        }
+      }
+    }
+  }
+
   ///Set prior trajectory
   void set_prior_trajectory(const Trajectory<Dim>& traj) {
     this->prior_traj_.clear();
     decimal_t total_time = traj.getTotalTime();
     const int n = std::ceil(this->v_max_ * total_time / map_util_->getRes());
-    const auto pts = traj.sample(n);
+    CommandArray<Dim> pts;
+    traj.sample(n, pts);
 
     std::vector<decimal_t> costs;
     for(decimal_t t = 0; t < total_time; t += this->dt_) {
       decimal_t potential_cost = 0;
       if(!potential_map_.empty()) {
         int prev_idx = -1;
-        for (const auto &pt : pts) {
-          if(pt.t >= t)
+        for (int i = 0; i < pts.size(); i++) {
+          if(pts.t(i) >= t)
             break;
-          const Veci<Dim> pn = map_util_->floatToInt(pt.pos);
+          const Veci<Dim> pn = map_util_->floatToInt(pts.pos.row(i).transpose());
           const int idx = map_util_->getIndex(pn);
           if(prev_idx == idx)
             continue;
           else
             prev_idx = idx;
           potential_cost += potential_weight_ * potential_map_[idx] +
-            gradient_weight_ * pt.vel.norm();
+            gradient_weight_ * pts.vel.row(i).norm();
         }
       }
       costs.push_back(this->w_ * t + potential_cost);
@@ -234,9 +441,10 @@ public:
         traverse_trajectory(traj) + this->w_ * total_time;
     printf("total cost: %f\n", total_cost);
 
+    auto cursor = traj.cursor();
     for(decimal_t t = 0; t < total_time; t += this->dt_) {
       int id = t / this->dt_;
-      this->prior_traj_.push_back(std::make_pair(traj.evaluate(t),
+      this->prior_traj_.push_back(std::make_pair(cursor.evaluate(t),
                                            total_cost - costs[id]));
     }
 
@@ -248,26 +456,29 @@ public:
     decimal_t total_time = traj.getTotalTime();
     int n = std::ceil(this->v_max_ * total_time / map_util_->getRes());
     decimal_t c = 0;
-    const auto pts = traj.sample(n);
+    CommandArray<Dim> pts;
+    traj.sample(n, pts);
+    Waypoint<Dim> w(traj.segs.empty() ? Control::VEL : traj.segs.front().control());
     int prev_idx = -1;
-    for (const auto &pt : pts) {
-      const Veci<Dim> pn = map_util_->floatToInt(pt.pos);
+    for (int i = 0; i < pts.size(); i++) {
+      const Veci<Dim> pn = map_util_->floatToInt(pts.pos.row(i).transpose());
       const int idx = map_util_->getIndex(pn);
       if(prev_idx == idx)
         continue;
       else
         prev_idx = idx;
+      w.yaw = pts.yaw(i);
       if (map_util_->isOutside(pn))
         return std::numeric_limits<decimal_t>::infinity();
       if(!potential_map_.empty()) {
         if(potential_map_[idx] < 100 && potential_map_[idx] > 0) {
           c += potential_weight_ * potential_map_[idx] +
-            gradient_weight_ * pt.vel.norm();
+            gradient_weight_ * pts.vel.row(i).norm();
         }
         else if(potential_map_[idx] >= 100)
           return std::numeric_limits<decimal_t>::infinity();
       }
-      else if (map_util_->isOccupied(pn))
+      else if (is_occupied(pn, w))
         return std::numeric_limits<decimal_t>::infinity();
     }
 
@@ -295,6 +506,10 @@ public:
       printf("+            tol_acc: %.2f               +\n", this->tol_acc_);
       printf("+            tol_yaw: %.2f               +\n", this->tol_yaw_);
       printf("+heur_ignore_dynamics: %d                 +\n", this->heur_ignore_dynamics_);
+      if(robot_r_ > 0)
+        printf("+        robot_radius: %.2f                 +\n", robot_r_);
+      if(!footprint_masks_.empty())
+        printf("+    footprint_radius: %.2f, %.2f           +\n", footprint_r_in_, footprint_r_out_);
       if(!potential_map_.empty())
         printf("+    potential_weight: %.2f                 +\n", potential_weight_);
       if(!gradient_map_.empty())
@@ -306,8 +521,26 @@ public:
 
 
 protected:
-  /// Collision checking util
-  std::shared_ptr<MapUtil<Dim>> map_util_;
+  /// Radius used with the clearance layer, circumscribed circle of the footprint if it is set
+  decimal_t collision_radius() const {
+    return footprint_masks_.empty() ? robot_r_ : footprint_r_out_;
+  }
+
+  /// Check if the point is inside the polygon by counting crossings
+  static bool point_in_polygon(const vec_Vec2f &vertices, const Vec2f &pt) {
+    bool inside = false;
+    for (size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++) {
+      const Vec2f &p1 = vertices[i];
+      const Vec2f &p2 = vertices[j];
+      if ((p1(1) > pt(1)) != (p2(1) > pt(1)) &&
+          pt(0) < (p2(0) - p1(0)) * (pt(1) - p1(1)) / (p2(1) - p1(1)) + p1(0))
+        inside = !inside;
+    }
+    return inside;
+  }
+
+  /// Collision checking util, read only
+  std::shared_ptr<const MapUtil<Dim>> map_util_;
   /// Potential map, optional
   std::vector<int8_t> potential_map_;
   /// Gradient map, optional
@@ -316,6 +549,14 @@ protected:
   decimal_t potential_weight_{0.1};
   /// Weight of gradient value
   decimal_t gradient_weight_{0.0};
+  /// Robot radius, zero means point robot
+  decimal_t robot_r_{0.0};
+  /// Footprint masks of cell offsets for each yaw bin, empty means no footprint
+  std::vector<vec_Veci<Dim>> footprint_masks_;
+  /// Radius of the inscribed circle of the footprint
+  decimal_t footprint_r_in_{0.0};
+  /// Radius of the circumscribed circle of the footprint
+  decimal_t footprint_r_out_{0.0};
 };
 }
 
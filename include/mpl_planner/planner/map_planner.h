@@ -23,8 +23,17 @@ public:
    * @param verbose enable debug messages
    */
   MapPlanner(bool verbose);
-  /// Set map util
-  virtual void setMapUtil(const std::shared_ptr<MapUtil<Dim>> &map_util);
+  /**
+   * @brief Set map util
+   *
+   * The map is only read by the planner, so planners on different threads
+   * can share one map as long as nobody modifies it while they plan; call
+   * `MapUtil::updateClearance()` once before sharing it if a robot radius or a
+   * footprint is used. The environment is rebuilt on the new map, so the
+   * settings of the old one (robot radius, footprint, control input, limits,
+   * potential map) have to be set again
+   */
+  virtual void setMapUtil(const std::shared_ptr<const MapUtil<Dim>> &map_util);
   /**
    * @brief Set valid region
    * @param path a sequence of waypoints from a path or trajectory
@@ -37,6 +46,13 @@ public:
   vec_Vecf<Dim> getSearchRegion() const;
   /// Get linked voxels
   vec_Vecf<Dim> getLinkedNodes() const;
+  /**
+   * @brief Rebuild the table from voxels to the primitives passing through
+   *
+   * Called by `updateBlockedNodes()` and `updateClearedNodes()` to match the
+   * current graph
+   */
+  void updateLinkedNodes();
   /**
    * @brief Update edge costs according to the new blocked nodes
    * @param pns the new occupied voxels
@@ -60,6 +76,33 @@ public:
   void setGradientWeight(decimal_t w);
   /// Set potential weight
   void setPotentialWeight(decimal_t w);
+  /**
+   * @brief Set robot radius
+   *
+   * Collision is checked against the clearance layer of the map util instead
+   * of a dilated copy. The layer has to be computed by
+   * `MapUtil::updateClearance()` before `setMapUtil()`, otherwise the radius
+   * is not set and false is returned
+   */
+  bool setRobotRadius(decimal_t r);
+  /**
+   * @brief Set polygon footprint of the robot in its body frame
+   *
+   * Collision is checked with a rasterized mask at the yaw of each sample,
+   * masks are built at the current dyaw resolution, so call `setDyaw()` first.
+   * The clearance layer is required as in `setRobotRadius()`
+   */
+  bool setFootprint(const vec_Vec2f& vertices);
+
+  /**
+   * @brief Get the potential map of this planner
+   *
+   * Same layout as `MapUtil::getMap()`, it is the map itself until
+   * `updatePotentialMap()` is called
+   */
+  const Tmap &getPotentialMap() const {
+    return potential_map_.empty() ? map_util_->getMap() : potential_map_;
+  }
 
   /// Get the potential cloud, works for 2D and 3D
   vec_Vec3f getPotentialCloud(decimal_t h_max = 1.0);
@@ -70,6 +113,8 @@ public:
    * @brief Generate potential map
    * @param pos center of the potential map range is zero, do global generation
    * @param pow power of potential field
+   *
+   * The potential map is kept by this planner, the map util is not modified
    */
   void updatePotentialMap(const Vecf<Dim>& pos, int pow = 1);
 
@@ -80,11 +125,18 @@ protected:
   /// Calculate local gradient map
   vec_E<Vecf<Dim>> calculateGradient(const Veci<Dim>& coord1,
                                      const Veci<Dim>& coord2);
-  /// Map util
-  std::shared_ptr<MapUtil<Dim>> map_util_;
+  /// Check that the map has the clearance layer, print an error otherwise
+  bool requireClearance(const char *setter) const;
+  /// Collect the voxels passed through by the primitives of the graph
+  void linkVoxels(vec_Vecf<Dim> *linked_pts, linkedHashMap *lhm) const;
+
+  /// Map util, read only
+  std::shared_ptr<const MapUtil<Dim>> map_util_;
 
   /// Linked table that records voxel and corresponding primitives passed through
-  mutable linkedHashMap lhm_;
+  linkedHashMap lhm_;
+  /// Potential map, empty if not generated
+  Tmap potential_map_;
 
   /// Max value for potential
   int8_t H_MAX{100};
@@ -13,7 +13,9 @@
 /**
  * @brief Trajectory generator back-end class
  *
- * Given intermediate waypoints and associated time allocation, generate the n-th order polynomials
+ * Given intermediate waypoints and associated time allocation, generate the n-th order polynomials.
+ * The free derivatives at waypoints are solved from a banded system, so the
+ * cost is linear in the number of segments.
  */
 template <int Dim>
 class PolySolver {
@@ -29,20 +31,86 @@ class PolySolver {
      * @param waypoints Intermediate waypoints that the trajectory pass through
      * @param dts Time allocation for each segment
      *
-     * Note that the element in dts is the time for that segment
+     * Note that the element in dts is the time for that segment.
+     * If dts and the control flags of waypoints are the same as the prepared
+     * ones, the factorization is reused, otherwise `prepare()` is called.
      */
     bool solve(const vec_E<Waypoint<Dim>>& waypoints, const std::vector<decimal_t> &dts);
+    /**
+     * @brief Factorize the system for a time allocation and a constraint pattern
+     * @param waypoints Only the control flags are used, they decide which derivatives are fixed
+     * @param dts Time allocation for each segment
+     */
+    bool prepare(const vec_E<Waypoint<Dim>>& waypoints, const std::vector<decimal_t> &dts);
+    /**
+     * @brief Solve for new waypoint values with the prepared factorization
+     *
+     * Only back substitution is needed. If the control flags of waypoints differ
+     * from the prepared ones, the system is prepared again with the same time allocation.
+     */
+    bool solve(const vec_E<Waypoint<Dim>>& waypoints);
+
+    /**
+     * @brief Optimize time allocation by minimizing \f$J + \rho\sum_i T_i\f$
+     * @param waypoints Intermediate waypoints that the trajectory pass through
+     * @param dts Initial time allocation, overwritten by the optimized one
+     * @param rho Weight of the total time
+     * @param max_solves Max number of solves, including the final one
+     *
+     * The trajectory of the optimized time allocation is solved on return.
+     * The gradient comes from the solved derivatives without extra solve.
+     * For paths of 16 segments or more on a multi-core machine, the
+     * candidates of each line search are solved in parallel by 3 threads,
+     * started once per call.
+     */
+    bool optimizeTime(const vec_E<Waypoint<Dim>>& waypoints, std::vector<decimal_t>& dts,
+                      decimal_t rho, int max_solves = 100);
+    ///Get the number of solves of the last `optimizeTime()`
+    int getNumSolves() const;
+
+    ///Get the cost \f$J = \sum_i\int_0^{T_i} |p^{(R)}(t)|^2dt\f$ of the last solve, summed over all axes
+    decimal_t cost() const;
+    ///Get the gradient of cost() wrt the time of each segment
+    std::vector<decimal_t> gradient() const;
 
     ///Get the solved trajectory
     std::shared_ptr<PolyTraj<Dim>> getTrajectory();
 
   protected:
+    ///Matrices A and Q of a segment with duration seg_time, and their derivatives wrt seg_time if dA and dQ are given
+    void segment(decimal_t seg_time, MatDf& A, MatDf& Q,
+                 MatDf* dA = nullptr, MatDf* dQ = nullptr) const;
+    ///Check if the r-th derivative at waypoint is fixed
+    static bool fixed(const Waypoint<Dim>& waypoint, unsigned int r);
+    ///Check if the system is prepared for the control flags of waypoints
+    bool prepared(const vec_E<Waypoint<Dim>>& waypoints) const;
+    ///Factorize the full system of free derivatives by LU, used if the band Cholesky fails
+    void factorizeDense();
+
     ///Number of coefficients of a polynomial
     unsigned int N_;
     ///Order of derivative to optimize
     unsigned int R_;
-    MatDf A_;
-    MatDf Q_;
+    ///Time allocation of the prepared system
+    std::vector<decimal_t> dts_;
+    ///Index of each waypoint derivative among the free ones, -1 if it is fixed
+    std::vector<int> free_id_;
+    ///Number of free derivatives
+    int num_free_derivatives_{0};
+    ///Inverse of the map from coefficients to boundary derivatives of each segment
+    std::vector<MatDf> A_inv_;
+    ///Cost of each segment in terms of its boundary derivatives
+    std::vector<MatDf> R_segs_;
+    ///Band Cholesky factor of the system of free derivatives
+    MatDf Rpp_;
+    ///If false, the system is not positive definite and `Rpp_lu_` is used
+    bool band_{true};
+    ///LU factorization of the system of free derivatives
+    Eigen::PartialPivLU<MatDf> Rpp_lu_;
+    ///Solved derivatives at waypoints
+    MatDNf<Dim> D_;
+    ///Number of solves of the last `optimizeTime()`
+    int num_solves_{0};
     ///Enble output on screen
     bool debug_;
     ///Solved trajectory
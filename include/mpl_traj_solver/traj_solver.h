@@ -67,7 +67,12 @@ public:
     waypoints_.back().control = control_;
   }
 
-  /// Solve for trajectory
+  /**
+   * @brief Solve for trajectory
+   *
+   * The factorizations of both position and yaw are kept, solving again with
+   * the same time allocation and control flags only costs back substitution.
+   */
   Trajectory<Dim> solve(bool verbose = false) {
     if (waypoints_.size() != dts_.size() + 1)
       dts_ = allocate_time(path_, v_);
@@ -108,6 +113,21 @@ public:
     }
   }
 
+  /**
+   * @brief Optimize the time allocation by minimizing \f$J + \rho T\f$
+   * @param rho Weight of the total time
+   * @param max_solves Max number of solves of the position, including the final one
+   *
+   * Start from the given time allocation or the one from `setV()`, the
+   * result replaces it and is used by the next `solve()`.
+   */
+  bool optimizeTime(decimal_t rho, int max_solves = 100) {
+    if (waypoints_.size() != dts_.size() + 1)
+      dts_ = allocate_time(path_, v_);
+    return poly_solver_ &&
+           poly_solver_->optimizeTime(waypoints_, dts_, rho, max_solves);
+  }
+
   /// Get the path used for time allocation
   vec_Vecf<Dim> getPath() const { return path_; }
 
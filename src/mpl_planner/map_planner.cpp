@@ -9,9 +9,23 @@ template <int Dim> MapPlanner<Dim>::MapPlanner(bool verbose) {
 }
 
 template <int Dim>
-void MapPlanner<Dim>::setMapUtil(const std::shared_ptr<MapUtil<Dim>> &map_util) {
+void MapPlanner<Dim>::setMapUtil(const std::shared_ptr<const MapUtil<Dim>> &map_util) {
   this->ENV_.reset(new MPL::env_map<Dim>(map_util));
   map_util_ = map_util;
+  // both are indexed by the voxels of the old map
+  potential_map_.clear();
+  lhm_.clear();
+}
+
+template <int Dim>
+bool MapPlanner<Dim>::requireClearance(const char *setter) const {
+  if (map_util_->hasClearance())
+    return true;
+  // the map may be shared by other planners, it is not copied nor modified
+  printf(ANSI_COLOR_RED "[MapPlanner] %s needs the clearance layer, call "
+         "updateClearance() on the map util before setMapUtil()!\n"
+         ANSI_COLOR_RESET, setter);
+  return false;
 }
 
 template <int Dim>
@@ -34,8 +48,29 @@ void MapPlanner<Dim>::setGradientWeight(decimal_t w) {
   this->ENV_->set_gradient_weight(w);
 }
 
+template <int Dim>
+bool MapPlanner<Dim>::setRobotRadius(decimal_t r) {
+  if (r > 0 && !requireClearance("setRobotRadius()"))
+    return false;
+  this->ENV_->set_robot_radius(r);
+  if (this->planner_verbose_)
+    printf("[MapPlanner] set robot radius: %f\n", r);
+  return true;
+}
+
+template <int Dim>
+bool MapPlanner<Dim>::setFootprint(const vec_Vec2f& vertices) {
+  if (!vertices.empty() && !requireClearance("setFootprint()"))
+    return false;
+  this->ENV_->set_footprint(vertices);
+  if (this->planner_verbose_)
+    printf("[MapPlanner] set footprint with %zu vertices\n", vertices.size());
+  return true;
+}
+
 template <int Dim>
 void MapPlanner<Dim>::setValidRegion(const vec_Vecf<Dim>& path, const Vecf<Dim>& search_radius, bool dense) {
+  MPL_TRACE_SCOPE("MapPlanner::setValidRegion");
   // create cells along path
   vec_Veci<Dim> ps;
   if(!dense) {
@@ -122,16 +157,33 @@ template <int Dim> vec_Vecf<Dim> MapPlanner<Dim>::getSearchRegion() const {
 }
 
 template <int Dim> vec_Vecf<Dim> MapPlanner<Dim>::getLinkedNodes() const {
-  lhm_.clear();
+  MPL_TRACE_SCOPE("MapPlanner::getLinkedNodes");
   vec_Vecf<Dim> linked_pts;
+  linkVoxels(&linked_pts, nullptr);
+  return linked_pts;
+}
+
+template <int Dim> void MapPlanner<Dim>::updateLinkedNodes() {
+  MPL_TRACE_SCOPE("MapPlanner::updateLinkedNodes");
+  lhm_.clear();
+  linkVoxels(nullptr, &lhm_);
+}
+
+template <int Dim>
+void MapPlanner<Dim>::linkVoxels(vec_Vecf<Dim> *linked_pts,
+                                 linkedHashMap *lhm) const {
+  vec_Vecf<Dim> ps;
   for (const auto &it : this->ss_ptr_->hm_) {
     if (!it.second)
       continue;
     // check pred array
     for (unsigned int i = 0; i < it.second->pred_hashkey.size(); i++) {
-      Key key = it.second->pred_hashkey[i];
+      auto pred = this->ss_ptr_->hm_.find(it.second->pred_hashkey[i]);
+      // the predecessor might have been evicted by the memory budget
+      if (pred == this->ss_ptr_->hm_.end())
+        continue;
       Primitive<Dim> pr;
-      this->ENV_->forward_action(this->ss_ptr_->hm_[key]->coord,
+      this->ENV_->forward_action(pred->second->coord,
                                  it.second->pred_action_id[i], pr);
       decimal_t max_v = 0;
       if (Dim == 2)
@@ -140,25 +192,27 @@ template <int Dim> vec_Vecf<Dim> MapPlanner<Dim>::getLinkedNodes() const {
         max_v = std::max(std::max(pr.max_vel(0), pr.max_vel(1)), pr.max_vel(2));
       int n = 1.0 * std::ceil(max_v * pr.t() / map_util_->getRes());
       int prev_id = -1;
-      vec_E<Waypoint<Dim>> ws = pr.sample(n);
-      for (const auto &w : ws) {
-        int id = map_util_->getIndex(map_util_->floatToInt(w.pos));
+      pr.samplePositions(n, ps);
+      for (const auto &pt : ps) {
+        int id = map_util_->getIndex(map_util_->floatToInt(pt));
         if (id != prev_id) {
-          linked_pts.push_back(
-              map_util_->intToFloat(map_util_->floatToInt(w.pos)));
-          lhm_[id].push_back(std::make_pair(it.second->hashkey, i));
+          if (linked_pts)
+            linked_pts->push_back(
+                map_util_->intToFloat(map_util_->floatToInt(pt)));
+          if (lhm)
+            (*lhm)[id].push_back(std::make_pair(it.second->hashkey, i));
           prev_id = id;
         }
       }
     }
   }
-
-  return linked_pts;
 }
 
 template <int Dim>
 vec_E<Primitive<Dim>>
 MapPlanner<Dim>::updateBlockedNodes(const vec_Veci<Dim> &blocked_pns) {
+  MPL_TRACE_SCOPE("MapPlanner::updateBlockedNodes");
+  updateLinkedNodes();
   std::vector<std::pair<Key, int>> blocked_nodes;
   for (const auto &it : blocked_pns) {
     int id = map_util_->getIndex(it);
@@ -175,6 +229,8 @@ MapPlanner<Dim>::updateBlockedNodes(const vec_Veci<Dim> &blocked_pns) {
 template <int Dim>
 vec_E<Primitive<Dim>>
 MapPlanner<Dim>::updateClearedNodes(const vec_Veci<Dim> &cleared_pns) {
+  MPL_TRACE_SCOPE("MapPlanner::updateClearedNodes");
+  updateLinkedNodes();
   std::vector<std::pair<Key, int>> cleared_nodes;
   for (const auto &it : cleared_pns) {
     int id = map_util_->getIndex(it);
@@ -190,7 +246,7 @@ MapPlanner<Dim>::updateClearedNodes(const vec_Veci<Dim> &cleared_pns) {
 
 template <int Dim>
 vec_Vec3f MapPlanner<Dim>::getPotentialCloud(decimal_t h_max) {
-  const auto data = map_util_->getMap();
+  const Tmap &data = getPotentialMap();
   const auto dim = map_util_->getDim();
   const decimal_t ratio = h_max / H_MAX;
   vec_Vec3f ps;
@@ -228,7 +284,6 @@ vec_Vec3f MapPlanner<Dim>::getPotentialCloud(decimal_t h_max) {
 
 template <int Dim>
 vec_Vec3f MapPlanner<Dim>::getGradientCloud(decimal_t h_max, int i) {
-  const auto data = map_util_->getMap();
   const auto dim = map_util_->getDim();
   const decimal_t ratio = h_max / H_MAX;
   vec_Vec3f ps;
@@ -253,7 +308,7 @@ vec_Vec3f MapPlanner<Dim>::getGradientCloud(decimal_t h_max, int i) {
 template <int Dim>
 vec_E<Vecf<Dim>> MapPlanner<Dim>::calculateGradient(const Veci<Dim>& coord1, const Veci<Dim>& coord2) {
   const auto dim = map_util_->getDim();
-  const auto cmap = map_util_->getMap();
+  const Tmap &cmap = getPotentialMap();
 
   int rn = std::ceil(potential_radius_(0)/map_util_->getRes());
 
@@ -328,6 +383,7 @@ void MapPlanner<Dim>::createMask(int pow) {
 
 template <int Dim>
 void MapPlanner<Dim>::updatePotentialMap(const Vecf<Dim>& pos, int pow) {
+  MPL_TRACE_SCOPE("MapPlanner::updatePotentialMap");
   createMask(pow);
   // compute a 2D local potential map
   const auto dim = map_util_->getDim();
@@ -349,8 +405,9 @@ void MapPlanner<Dim>::updatePotentialMap(const Vecf<Dim>& pos, int pow) {
     }
   }
 
-  std::vector<int8_t> map = map_util_->getMap();
-  auto dmap = map;
+  // dilate the map of the util, which stays untouched
+  const Tmap &map = map_util_->getMap();
+  Tmap dmap = map;
 
   Veci<Dim> n;
   if(Dim == 2) {
@@ -392,8 +449,8 @@ void MapPlanner<Dim>::updatePotentialMap(const Vecf<Dim>& pos, int pow) {
 		}
 	}
 
-	map_util_->setMap(map_util_->getOrigin(), dim, dmap, map_util_->getRes());
-  this->ENV_->set_potential_map(map_util_->getMap());
+  potential_map_ = std::move(dmap);
+  this->ENV_->set_potential_map(potential_map_);
   //gradient_map_ = calculateGradient(coord1, coord2);
   //this->ENV_->set_gradient_map(gradient_map_);
 }
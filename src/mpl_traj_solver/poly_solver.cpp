@@ -1,4 +1,9 @@
+#include <mpl_basis/trace.h>
 #include <mpl_traj_solver/poly_solver.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 template <int Dim>
 PolySolver<Dim>::PolySolver(unsigned int smooth_derivative_order,
@@ -13,214 +18,348 @@ std::shared_ptr<PolyTraj<Dim>> PolySolver<Dim>::getTrajectory() {
   return ptraj_;
 }
 
+/**
+ * @brief Cholesky factorization of a symmetric positive definite band matrix in place
+ * @param H lower band, H(i, k) is the element (i, i - k) for 0 <= k <= bandwidth
+ *
+ * Return false if a pivot is not positive
+ */
+static bool band_cholesky(MatDf &H) {
+  const int n = H.rows();
+  const int bw = H.cols() - 1;
+  for (int j = 0; j < n; j++) {
+    decimal_t s = H(j, 0);
+    for (int k = 1; k <= std::min(bw, j); k++)
+      s -= H(j, k) * H(j, k);
+    if (!(s > 0))
+      return false;
+    H(j, 0) = std::sqrt(s);
+    for (int i = j + 1; i <= std::min(n - 1, j + bw); i++) {
+      decimal_t v = H(i, i - j);
+      for (int k = std::max(0, i - bw); k < j; k++)
+        v -= H(i, i - k) * H(j, j - k);
+      H(i, i - j) = v / H(j, 0);
+    }
+  }
+  return true;
+}
+
+/// Solve \f$LL^Tx = b\f$ in place given the band Cholesky factor from `band_cholesky()`
 template <int Dim>
-bool PolySolver<Dim>::solve(const vec_E<Waypoint<Dim>> &waypoints,
-                            const std::vector<decimal_t> &dts) {
-  ptraj_->clear();
-  ptraj_->setWaypoints(waypoints);
-  ptraj_->setTime(dts);
+static void band_solve(const MatDf &L, MatDNf<Dim> &b) {
+  const int n = L.rows();
+  const int bw = L.cols() - 1;
+  for (int i = 0; i < n; i++) {
+    for (int k = std::max(0, i - bw); k < i; k++)
+      b.row(i) -= L(i, i - k) * b.row(k);
+    b.row(i) /= L(i, 0);
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    for (int k = i + 1; k <= std::min(n - 1, i + bw); k++)
+      b.row(i) -= L(k, k - i) * b.row(k);
+    b.row(i) /= L(i, 0);
+  }
+}
 
-  const unsigned int num_waypoints = waypoints.size();
-  const unsigned int num_segments = num_waypoints - 1;
-  if (num_waypoints < 2)
+/**
+ * @brief Threads that run the same job with their own index
+ *
+ * The threads are started once and wait between the jobs, so a job only
+ * costs a wake-up instead of starting threads.
+ */
+class WorkerPool {
+public:
+  explicit WorkerPool(int num_threads) {
+    for (int k = 0; k < num_threads; k++)
+      threads_.emplace_back(&WorkerPool::loop, this, k + 1);
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto &thread : threads_)
+      thread.join();
+  }
+
+  /// Run job(1) to job(n) on the n threads and job(0) on the caller, wait for all
+  void run(const std::function<void(int)> &job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      pending_ = threads_.size();
+      generation_++;
+    }
+    start_cv_.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+private:
+  void loop(int id) {
+    unsigned int generation = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      start_cv_.wait(lock, [&] { return stop_ || generation_ != generation; });
+      if (stop_)
+        return;
+      generation = generation_;
+      const std::function<void(int)> &job = *job_;
+      lock.unlock();
+      job(id);
+      lock.lock();
+      if (--pending_ == 0)
+        done_cv_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int)> *job_ = nullptr;
+  /// Number of threads still running the job
+  int pending_ = 0;
+  /// Incremented for each job
+  unsigned int generation_ = 0;
+  bool stop_ = false;
+};
+
+template <int Dim>
+bool PolySolver<Dim>::fixed(const Waypoint<Dim> &waypoint, unsigned int r) {
+  return (r == 0 && waypoint.use_pos) || (r == 1 && waypoint.use_vel) ||
+         (r == 2 && waypoint.use_acc) || (r == 3 && waypoint.use_jrk);
+}
+
+template <int Dim>
+bool PolySolver<Dim>::prepared(const vec_E<Waypoint<Dim>> &waypoints) const {
+  const unsigned int num_derivatives = N_ / 2;
+  if (waypoints.size() * num_derivatives != free_id_.size() ||
+      waypoints.size() != dts_.size() + 1)
     return false;
-  if (debug_) {
-    for (unsigned int i = 0; i < num_waypoints; i++)
-      waypoints[i].print("waypoint" + std::to_string(i) + ":");
+  for (unsigned int k = 0; k < waypoints.size(); k++) {
+    for (unsigned int r = 0; r < num_derivatives; r++) {
+      if (fixed(waypoints[k], r) != (free_id_[k * num_derivatives + r] < 0))
+        return false;
+    }
   }
+  return true;
+}
 
-  MatDf A = MatDf::Zero(num_segments * N_, num_segments * N_);
-  MatDf Q = MatDf::Zero(num_segments * N_, num_segments * N_);
-  for (unsigned int i = 0; i < num_segments; i++) {
-    decimal_t seg_time = dts[i];
-    // n column
-    for (unsigned int n = 0; n < N_; n++) {
-      // A_0
-      if (n < N_ / 2) {
+template <int Dim>
+void PolySolver<Dim>::segment(decimal_t seg_time, MatDf &A, MatDf &Q,
+                              MatDf *dA, MatDf *dQ) const {
+  A = MatDf::Zero(N_, N_);
+  Q = MatDf::Zero(N_, N_);
+  if (dA)
+    *dA = MatDf::Zero(N_, N_);
+  if (dQ)
+    *dQ = MatDf::Zero(N_, N_);
+  // n column
+  for (unsigned int n = 0; n < N_; n++) {
+    // A_0
+    if (n < N_ / 2) {
+      int val = 1;
+      for (unsigned int m = 0; m < n; m++)
+        val *= (n - m);
+      A(n, n) = val;
+    }
+    // A_T
+    for (unsigned int r = 0; r < N_ / 2; r++) {
+      if (r <= n) {
         int val = 1;
-        for (unsigned int m = 0; m < n; m++)
+        for (unsigned int m = 0; m < r; m++)
           val *= (n - m);
-        A(i * N_ + n, i * N_ + n) = val;
-      }
-      // A_T
-      for (unsigned int r = 0; r < N_ / 2; r++) {
-        if (r <= n) {
-          int val = 1;
-          for (unsigned int m = 0; m < r; m++)
-            val *= (n - m);
-          A(i * N_ + N_ / 2 + r, i * N_ + n) = val * power(seg_time, n - r);
-        }
+        A(N_ / 2 + r, n) = val * power(seg_time, n - r);
+        if (dA && r < n)
+          (*dA)(N_ / 2 + r, n) = val * (n - r) * power(seg_time, n - r - 1);
       }
-      // Q
-      for (unsigned int r = 0; r < N_; r++) {
-        if (r >= R_ && n >= R_) {
-          int val = 1;
-          for (unsigned int m = 0; m < R_; m++)
-            val *= (r - m) * (n - m);
-          Q(i * N_ + r, i * N_ + n) =
-              val * power(seg_time, r + n - 2 * R_ + 1) / (r + n - 2 * R_ + 1);
-        }
+    }
+    // Q
+    for (unsigned int r = 0; r < N_; r++) {
+      if (r >= R_ && n >= R_) {
+        int val = 1;
+        for (unsigned int m = 0; m < R_; m++)
+          val *= (r - m) * (n - m);
+        Q(r, n) =
+            val * power(seg_time, r + n - 2 * R_ + 1) / (r + n - 2 * R_ + 1);
+        if (dQ)
+          (*dQ)(r, n) = val * power(seg_time, r + n - 2 * R_);
       }
     }
   }
+}
 
-  A_ = A;
-  Q_ = Q;
+template <int Dim>
+bool PolySolver<Dim>::prepare(const vec_E<Waypoint<Dim>> &waypoints,
+                              const std::vector<decimal_t> &dts) {
+  free_id_.clear();
+  dts_.clear();
+  D_.resize(0, Dim);
+  const unsigned int num_waypoints = waypoints.size();
+  if (num_waypoints < 2 || dts.size() + 1 < num_waypoints)
+    return false;
+  const unsigned int num_segments = num_waypoints - 1;
+  dts_.assign(dts.begin(), dts.begin() + num_segments);
 
-  const unsigned int smooth_derivative_order = N_ / 2 - 1;
-  const unsigned int num_total_derivatives = num_waypoints * N_ / 2;
-  unsigned int num_fixed_derivatives = 0;
-  for (const auto &it : waypoints) {
-    if (it.use_pos && smooth_derivative_order >= 0)
-      num_fixed_derivatives++;
-    if (it.use_vel && smooth_derivative_order >= 1)
-      num_fixed_derivatives++;
-    if (it.use_acc && smooth_derivative_order >= 2)
-      num_fixed_derivatives++;
-    if (it.use_jrk && smooth_derivative_order >= 3)
-      num_fixed_derivatives++;
+  // The r-th derivative at the k-th waypoint is indexed by k * N_ / 2 + r, so
+  // that the boundary derivatives of the i-th segment are the N_ ones from
+  // i * N_ / 2. Free derivatives are numbered in the same order.
+  const unsigned int num_derivatives = N_ / 2;
+  free_id_.resize(num_waypoints * num_derivatives, -1);
+  num_free_derivatives_ = 0;
+  for (unsigned int k = 0; k < num_waypoints; k++) {
+    for (unsigned int r = 0; r < num_derivatives; r++) {
+      if (!fixed(waypoints[k], r))
+        free_id_[k * num_derivatives + r] = num_free_derivatives_++;
+    }
   }
-  const unsigned int num_free_derivatives =
-      num_total_derivatives - num_fixed_derivatives;
   if (debug_)
     printf("num_fixed_derivatives: %d, num_free_derivatives: %d\n",
-           num_fixed_derivatives, num_free_derivatives);
-
-  std::vector<std::pair<unsigned int, unsigned int>> permutation_table;
-  unsigned int raw_cnt = 0;
-  unsigned int fix_cnt = 0;
-  unsigned int free_cnt = 0;
-  unsigned int id = 0;
-  for (const auto &it : waypoints) {
-    if (it.use_pos && smooth_derivative_order >= 0) {
-      permutation_table.push_back(std::make_pair(raw_cnt, fix_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(std::make_pair(raw_cnt + N_ / 2, fix_cnt));
-      raw_cnt++;
-      fix_cnt++;
-    } else if (!it.use_pos && smooth_derivative_order >= 0) {
-      permutation_table.push_back(
-          std::make_pair(raw_cnt, num_fixed_derivatives + free_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(
-            std::make_pair(raw_cnt + N_ / 2, num_fixed_derivatives + free_cnt));
-      raw_cnt++;
-      free_cnt++;
-    }
-    if (it.use_vel && smooth_derivative_order >= 1) {
-      permutation_table.push_back(std::make_pair(raw_cnt, fix_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(std::make_pair(raw_cnt + N_ / 2, fix_cnt));
-      raw_cnt++;
-      fix_cnt++;
-    } else if (!it.use_vel && smooth_derivative_order >= 1) {
-      permutation_table.push_back(
-          std::make_pair(raw_cnt, num_fixed_derivatives + free_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(
-            std::make_pair(raw_cnt + N_ / 2, num_fixed_derivatives + free_cnt));
-      raw_cnt++;
-      free_cnt++;
-    }
-    if (it.use_acc && smooth_derivative_order >= 2) {
-      permutation_table.push_back(std::make_pair(raw_cnt, fix_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(std::make_pair(raw_cnt + N_ / 2, fix_cnt));
-      raw_cnt++;
-      fix_cnt++;
-    } else if (!it.use_acc && smooth_derivative_order >= 2) {
-      permutation_table.push_back(
-          std::make_pair(raw_cnt, num_fixed_derivatives + free_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(
-            std::make_pair(raw_cnt + N_ / 2, num_fixed_derivatives + free_cnt));
-      raw_cnt++;
-      free_cnt++;
-    }
-    if (it.use_jrk && smooth_derivative_order >= 3) {
-      permutation_table.push_back(std::make_pair(raw_cnt, fix_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(std::make_pair(raw_cnt + N_ / 2, fix_cnt));
-      raw_cnt++;
-      fix_cnt++;
-    } else if (!it.use_jrk && smooth_derivative_order >= 3) {
-      permutation_table.push_back(
-          std::make_pair(raw_cnt, num_fixed_derivatives + free_cnt));
-      if (id > 0 && id < num_waypoints - 1)
-        permutation_table.push_back(
-            std::make_pair(raw_cnt + N_ / 2, num_fixed_derivatives + free_cnt));
-      raw_cnt++;
-      free_cnt++;
-    }
-
-    if (id > 0 && id < num_waypoints - 1)
-      raw_cnt += N_ / 2;
-    id++;
+           (int)free_id_.size() - num_free_derivatives_, num_free_derivatives_);
+
+  // For each segment, A maps coefficients to boundary derivatives and R is the
+  // cost in terms of boundary derivatives, \f$R = A^{-T}QA^{-1}\f$
+  A_inv_.resize(num_segments);
+  R_segs_.resize(num_segments);
+  for (unsigned int i = 0; i < num_segments; i++) {
+    MatDf A, Q;
+    segment(dts_[i], A, Q);
+    A_inv_[i] = A.partialPivLu().inverse();
+    R_segs_[i] = A_inv_[i].transpose() * Q * A_inv_[i];
+    if (debug_) {
+      std::cout << "A" << i << ":\n" << A << std::endl;
+      std::cout << "R" << i << ":\n" << R_segs_[i] << std::endl;
+    }
   }
 
-  if (debug_) {
-    std::cout << "permutation_table: \n" << std::endl;
-    for (auto it : permutation_table)
-      std::cout << "old id: " << it.first << " new_id: " << it.second
-                << std::endl;
+  // Free derivatives of a segment are within N_ - 1 of each other, the
+  // system of free derivatives is block tridiagonal and is stored as a band
+  int bandwidth = 0;
+  for (unsigned int i = 0; i < num_segments; i++) {
+    int lo = num_free_derivatives_, hi = -1;
+    for (unsigned int a = 0; a < N_; a++) {
+      const int fa = free_id_[i * num_derivatives + a];
+      if (fa >= 0) {
+        lo = std::min(lo, fa);
+        hi = std::max(hi, fa);
+      }
+    }
+    bandwidth = std::max(bandwidth, hi - lo);
   }
 
-  // M
-  MatDf M = MatDf::Zero(num_segments * N_, num_waypoints * N_ / 2);
-  for (const auto &it : permutation_table)
-    M(it.first, it.second) = 1;
+  Rpp_ = MatDf::Zero(num_free_derivatives_, bandwidth + 1);
+  for (unsigned int i = 0; i < num_segments; i++) {
+    for (unsigned int a = 0; a < N_; a++) {
+      const int fa = free_id_[i * num_derivatives + a];
+      for (unsigned int c = 0; c < N_ && fa >= 0; c++) {
+        const int fc = free_id_[i * num_derivatives + c];
+        if (fc >= 0 && fc <= fa)
+          Rpp_(fa, fa - fc) += R_segs_[i](a, c);
+      }
+    }
+  }
 
-  // Eigen::MatrixXf A_inv = A.inverse();
-  MatDf A_inv_M = A.partialPivLu().solve(M);
-  MatDf R = A_inv_M.transpose() * Q * A_inv_M;
-  if (debug_) {
-    std::cout << "A:\n" << A << std::endl;
-    std::cout << "Q:\n" << Q << std::endl;
-    std::cout << "M:\n" << M << std::endl;
-    std::cout << "A_inv_M:\n" << A_inv_M << std::endl;
-    std::cout << "R:\n" << R << std::endl;
-  }
-  MatDf Rpp = R.block(num_fixed_derivatives, num_fixed_derivatives,
-                      num_free_derivatives, num_free_derivatives);
-  MatDf Rpf = R.block(num_fixed_derivatives, 0, num_free_derivatives,
-                      num_fixed_derivatives);
-
-  // Fixed derivatives
-  MatDNf<Dim> Df = MatDNf<Dim>(num_fixed_derivatives, Dim);
-  for (const auto &it : permutation_table) {
-    if (it.second < num_fixed_derivatives) {
-      int id = std::floor((it.first + N_ / 2) / N_);
-      int derivative = it.first % (N_ / 2);
-      if (derivative == 0)
-        Df.row(it.second) = waypoints[id].pos.transpose();
-      else if (derivative == 1)
-        Df.row(it.second) = waypoints[id].vel.transpose();
-      else if (derivative == 2)
-        Df.row(it.second) = waypoints[id].acc.transpose();
-      else if (derivative == 3)
-        Df.row(it.second) = waypoints[id].jrk.transpose();
+  band_ = band_cholesky(Rpp_);
+  if (!band_) // not positive definite
+    factorizeDense();
+  return true;
+}
+
+template <int Dim>
+void PolySolver<Dim>::factorizeDense() {
+  const unsigned int num_derivatives = N_ / 2;
+  MatDf Rpp = MatDf::Zero(num_free_derivatives_, num_free_derivatives_);
+  for (unsigned int i = 0; i < R_segs_.size(); i++) {
+    for (unsigned int a = 0; a < N_; a++) {
+      const int fa = free_id_[i * num_derivatives + a];
+      for (unsigned int c = 0; c < N_ && fa >= 0; c++) {
+        const int fc = free_id_[i * num_derivatives + c];
+        if (fc >= 0)
+          Rpp(fa, fc) += R_segs_[i](a, c);
+      }
     }
   }
+  Rpp_lu_.compute(Rpp);
+  band_ = false;
+}
 
-  if (debug_)
-    std::cout << "Df:\n" << Df << std::endl;
-  MatDNf<Dim> D = MatDNf<Dim>(num_waypoints * N_ / 2, Dim);
-  D.topRows(num_fixed_derivatives) = Df;
+template <int Dim>
+bool PolySolver<Dim>::solve(const vec_E<Waypoint<Dim>> &waypoints,
+                            const std::vector<decimal_t> &dts) {
+  const unsigned int num_segments = waypoints.empty() ? 0 : waypoints.size() - 1;
+  const bool same_dts = dts.size() >= num_segments && dts_.size() == num_segments &&
+                        std::equal(dts_.begin(), dts_.end(), dts.begin());
+  if (!same_dts || !prepared(waypoints)) {
+    if (!prepare(waypoints, dts)) {
+      ptraj_->clear();
+      return false;
+    }
+  }
+  return solve(waypoints);
+}
+
+template <int Dim>
+bool PolySolver<Dim>::solve(const vec_E<Waypoint<Dim>> &waypoints) {
+  MPL_TRACE_SCOPE("PolySolver::solve");
+  ptraj_->clear();
+  if (!prepared(waypoints) && !prepare(waypoints, dts_))
+    return false;
+  ptraj_->setWaypoints(waypoints);
+  ptraj_->setTime(dts_);
 
-  if (num_waypoints > 2 && num_free_derivatives > 0) {
-    MatDNf<Dim> Dp = -Rpp.partialPivLu().solve(Rpf * Df);
+  const unsigned int num_waypoints = waypoints.size();
+  const unsigned int num_segments = num_waypoints - 1;
+  if (debug_) {
+    for (unsigned int i = 0; i < num_waypoints; i++)
+      waypoints[i].print("waypoint" + std::to_string(i) + ":");
+  }
+
+  const unsigned int num_derivatives = N_ / 2;
+  MatDNf<Dim> D = MatDNf<Dim>::Zero(num_waypoints * num_derivatives, Dim);
+  for (unsigned int k = 0; k < num_waypoints; k++) {
+    const auto &it = waypoints[k];
+    const Vecf<Dim> *value[4] = {&it.pos, &it.vel, &it.acc, &it.jrk};
+    for (unsigned int r = 0; r < num_derivatives; r++) {
+      if (free_id_[k * num_derivatives + r] < 0)
+        D.row(k * num_derivatives + r) = value[r]->transpose();
+    }
+  }
+
+  // Minimize \f$D^TRD\f$ over free derivatives: \f$R_{pp}D_p = -R_{pf}D_f\f$
+  if (num_free_derivatives_ > 0) {
+    MatDNf<Dim> Dp = MatDNf<Dim>::Zero(num_free_derivatives_, Dim);
+    for (unsigned int i = 0; i < num_segments; i++) {
+      for (unsigned int a = 0; a < N_; a++) {
+        const int fa = free_id_[i * num_derivatives + a];
+        for (unsigned int c = 0; c < N_ && fa >= 0; c++) {
+          const unsigned int id = i * num_derivatives + c;
+          if (free_id_[id] < 0)
+            Dp.row(fa) -= R_segs_[i](a, c) * D.row(id);
+        }
+      }
+    }
+    if (band_)
+      band_solve<Dim>(Rpp_, Dp);
+    else
+      Dp = Rpp_lu_.solve(Dp);
     if (debug_)
       std::cout << "Dp:\n" << Dp << std::endl;
-    D.bottomRows(num_free_derivatives) = Dp;
+    for (unsigned int id = 0; id < free_id_.size(); id++) {
+      if (free_id_[id] >= 0)
+        D.row(id) = Dp.row(free_id_[id]);
+    }
   }
 
-  MatDNf<Dim> d = M * D;
   if (debug_)
-    std::cout << "d:\n" << d << std::endl;
+    std::cout << "D:\n" << D << std::endl;
+  D_ = D;
   for (unsigned int i = 0; i < num_segments; i++) {
-    const MatDNf<Dim> p = A.block(i * N_, i * N_, N_, N_)
-                              .partialPivLu()
-                              .solve(d.block(i * N_, 0, N_, Dim));
+    const MatDNf<Dim> p =
+        A_inv_[i] * D.block(i * num_derivatives, 0, N_, Dim);
     if (debug_)
       std::cout << "p:\n" << p << std::endl;
     ptraj_->addCoeff(p);
@@ -228,6 +367,170 @@ bool PolySolver<Dim>::solve(const vec_E<Waypoint<Dim>> &waypoints,
   return true;
 }
 
+template <int Dim>
+decimal_t PolySolver<Dim>::cost() const {
+  const unsigned int num_derivatives = N_ / 2;
+  decimal_t J = 0;
+  for (unsigned int i = 0; i < R_segs_.size() && D_.rows() > 0; i++) {
+    const auto d = D_.block(i * num_derivatives, 0, N_, Dim);
+    J += (d.transpose() * R_segs_[i] * d).trace();
+  }
+  return J;
+}
+
+template <int Dim>
+std::vector<decimal_t> PolySolver<Dim>::gradient() const {
+  // The free derivatives are optimal, so only the explicit dependence of each
+  // segment on its time counts. With coefficients p = A^{-1}d fixed at d:
+  // dJ/dT = p^TQ'p - 2(A^{-T}Qp)^T A'p
+  const unsigned int num_derivatives = N_ / 2;
+  std::vector<decimal_t> g(R_segs_.size(), 0);
+  for (unsigned int i = 0; i < R_segs_.size() && D_.rows() > 0; i++) {
+    MatDf A, Q, dA, dQ;
+    segment(dts_[i], A, Q, &dA, &dQ);
+    const MatDNf<Dim> p = A_inv_[i] * D_.block(i * num_derivatives, 0, N_, Dim);
+    const MatDNf<Dim> lambda = A_inv_[i].transpose() * (Q * p);
+    g[i] = (p.transpose() * dQ * p).trace() -
+           2 * (lambda.transpose() * dA * p).trace();
+  }
+  return g;
+}
+
+template <int Dim>
+bool PolySolver<Dim>::optimizeTime(const vec_E<Waypoint<Dim>> &waypoints,
+                                   std::vector<decimal_t> &dts, decimal_t rho,
+                                   int max_solves) {
+  const int num_segments = (int)waypoints.size() - 1;
+  if (num_segments < 1 || (int)dts.size() < num_segments)
+    return false;
+  dts.resize(num_segments);
+  // start from positive times
+  decimal_t mean_dt = 0;
+  for (const auto &dt : dts)
+    mean_dt += std::max<decimal_t>(dt, 0) / num_segments;
+  if (!(mean_dt > 0))
+    mean_dt = 1;
+  for (auto &dt : dts)
+    dt = std::max(dt, 1e-3 * mean_dt);
+
+  // Gradient descent on x = log(T) with Barzilai-Borwein steps, each step is
+  // searched among candidates that halve the step. The candidates are solved
+  // in parallel if a solve takes longer than waking up a thread.
+  const int num_candidates = 4;
+  std::unique_ptr<WorkerPool> pool;
+  if (std::thread::hardware_concurrency() > 1 && num_segments >= 16)
+    pool.reset(new WorkerPool(num_candidates - 1));
+  std::vector<std::unique_ptr<PolySolver<Dim>>> workers;
+  for (int k = 0; k < num_candidates; k++)
+    workers.emplace_back(new PolySolver<Dim>(N_ / 2 - 1, R_));
+  auto evaluate = [&](PolySolver<Dim> &solver, const std::vector<decimal_t> &ts) {
+    if (!solver.solve(waypoints, ts))
+      return std::numeric_limits<decimal_t>::infinity();
+    decimal_t f = solver.cost();
+    for (const auto &t : ts)
+      f += rho * t;
+    return f;
+  };
+  // gradient of the objective wrt x
+  auto gradient_x = [&](const PolySolver<Dim> &solver, const std::vector<decimal_t> &ts) {
+    std::vector<decimal_t> g = solver.gradient();
+    for (int i = 0; i < num_segments; i++)
+      g[i] = (g[i] + rho) * ts[i];
+    return g;
+  };
+
+  num_solves_ = 0;
+  if (max_solves < 1)
+    return false;
+  decimal_t f = evaluate(*this, dts);
+  num_solves_ = 1;
+  if (std::isinf(f))
+    return false;
+  std::vector<decimal_t> g = gradient_x(*this, dts);
+  std::vector<decimal_t> s_prev, g_prev;
+  // the trajectory of dts is solved by this solver until a step is taken,
+  // one solve is kept in the budget to solve it again at the end
+  bool solved = true;
+  while (num_solves_ + num_candidates + 1 <= max_solves) {
+    decimal_t g_max = 0, g_sq = 0;
+    for (const auto &gi : g) {
+      g_max = std::max(g_max, std::abs(gi));
+      g_sq += gi * gi;
+    }
+    if (g_max <= 1e-6 * std::max<decimal_t>(f, 1e-12))
+      break;
+
+    // step size, the change of each log time is at most 1
+    decimal_t alpha = 0;
+    if (!s_prev.empty()) {
+      decimal_t sy = 0, yy = 0;
+      for (int i = 0; i < num_segments; i++) {
+        const decimal_t y = g[i] - g_prev[i];
+        sy += s_prev[i] * y;
+        yy += y * y;
+      }
+      if (sy > 0 && yy > 0)
+        alpha = sy / yy;
+    }
+    if (!(alpha > 0) || alpha * g_max > 1)
+      alpha = 1 / g_max;
+
+    std::vector<std::vector<decimal_t>> ts(num_candidates, dts);
+    std::vector<decimal_t> fs(num_candidates);
+    for (int k = 0; k < num_candidates; k++) {
+      const decimal_t a = alpha / (1 << k);
+      for (int i = 0; i < num_segments; i++)
+        ts[k][i] = dts[i] * std::exp(-a * g[i]);
+    }
+    const std::function<void(int)> job = [&](int k) {
+      fs[k] = evaluate(*workers[k], ts[k]);
+    };
+    if (pool)
+      pool->run(job);
+    else {
+      for (int k = 0; k < num_candidates; k++)
+        job(k);
+    }
+    num_solves_ += num_candidates;
+
+    // the best candidate that satisfies the Armijo condition
+    int best = -1;
+    for (int k = 0; k < num_candidates; k++) {
+      const decimal_t a = alpha / (1 << k);
+      if (fs[k] <= f - 1e-4 * a * g_sq && (best < 0 || fs[k] < fs[best]))
+        best = k;
+    }
+    if (best < 0)
+      break;
+
+    s_prev.resize(num_segments);
+    for (int i = 0; i < num_segments; i++)
+      s_prev[i] = std::log(ts[best][i] / dts[i]);
+    g_prev = g;
+    const decimal_t f_prev = f;
+    dts = ts[best];
+    f = fs[best];
+    g = gradient_x(*workers[best], dts);
+    solved = false;
+    if (f_prev - f <= 1e-9 * f_prev)
+      break;
+  }
+
+  bool success = true;
+  if (!solved) {
+    success = solve(waypoints, dts);
+    num_solves_++;
+  }
+  if (debug_)
+    printf("optimizeTime: cost %f after %d solves\n", f, num_solves_);
+  return success;
+}
+
+template <int Dim>
+int PolySolver<Dim>::getNumSolves() const {
+  return num_solves_;
+}
+
 template class PolySolver<1>;
 
 template class PolySolver<2>;
@@ -0,0 +1,111 @@
+#include "read_map.hpp"
+#include <mpl_planner/common/async_planner.h>
+#include <mpl_planner/planner/map_planner.h>
+
+typedef MPL::AsyncPlanner<2> AsyncPlanner2D;
+
+const char *status_name(AsyncPlanner2D::Status status) {
+  switch (status) {
+  case AsyncPlanner2D::SUCCESS:
+    return "SUCCESS";
+  case AsyncPlanner2D::FAILURE:
+    return "FAILURE";
+  case AsyncPlanner2D::PARTIAL:
+    return "PARTIAL";
+  default:
+    return "CANCELLED";
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf(ANSI_COLOR_RED "Input yaml required!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+
+  // Load the map
+  MapReader<Vec2i, Vec2f> reader(argv[1]);
+  if (!reader.exist()) {
+    printf(ANSI_COLOR_RED "Cannot find input file [%s]!\n" ANSI_COLOR_RESET,
+           argv[1]);
+    return -1;
+  }
+
+  std::shared_ptr<MPL::OccMapUtil> map_util(new MPL::OccMapUtil);
+  map_util->setMap(reader.origin(), reader.dim(), reader.data(),
+                   reader.resolution());
+  map_util->freeUnknown();
+
+  // Initialize start and goal, using vel control
+  Waypoint2D start(Control::VEL), goal(Control::VEL);
+  start.pos = Vec2f(reader.start(0), reader.start(1));
+  start.vel = Vec2f::Zero();
+  goal.pos = Vec2f(reader.goal(0), reader.goal(1));
+  goal.vel = Vec2f::Zero();
+
+  const decimal_t u = 0.5;
+  vec_E<VecDf> U;
+  for (decimal_t dx = -u; dx <= u; dx += u)
+    for (decimal_t dy = -u; dy <= u; dy += u)
+      U.push_back(Vec2f(dx, dy));
+
+  std::shared_ptr<MPL::OccMapPlanner> planner(new MPL::OccMapPlanner(false));
+  planner->setMapUtil(map_util);
+  planner->setVmax(1.0);
+  planner->setDt(1.0);
+  planner->setU(U);
+
+  // The blocking plan as reference
+  if (!planner->plan(start, goal)) {
+    printf(ANSI_COLOR_RED "Blocking plan failed!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+  const int expansions = planner->getExpandedNum();
+  const decimal_t total_t = planner->getTraj().getTotalTime();
+  planner->reset();
+
+  bool passed = true;
+  AsyncPlanner2D async_planner(planner);
+
+  // The second request pre-empts the first one or replaces it in the queue,
+  // and is replaced by the third one in the same way
+  auto first = async_planner.submit(start, goal);
+  auto second = async_planner.submit(start, goal);
+  auto third = async_planner.submit(start, goal);
+  printf("Pre-empted or replaced requests: %s, %s\n",
+         status_name(first.get().status), status_name(second.get().status));
+  const auto result = third.get();
+  printf("Last request: %s with %d expansions, T: %f\n",
+         status_name(result.status), result.expansions,
+         result.traj.getTotalTime());
+  if (first.get().status != AsyncPlanner2D::CANCELLED ||
+      second.get().status != AsyncPlanner2D::CANCELLED ||
+      result.status != AsyncPlanner2D::SUCCESS ||
+      result.expansions != expansions ||
+      result.traj.getTotalTime() != total_t)
+    passed = false;
+
+  // Cancelling a request wakes up a concurrent wait(), also if the worker
+  // has not started it yet. The request may also finish before cancel()
+  for (int i = 0; i < 100; i++) {
+    async_planner.submit(start, goal);
+    auto waiter = std::async(std::launch::async,
+                             [&async_planner] { async_planner.wait(); });
+    async_planner.cancel();
+    if (waiter.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+      printf("wait() is not woken up by cancel()!\n");
+      passed = false;
+      // the waiter is woken up by the next request
+      async_planner.submit(start, goal);
+      break;
+    }
+  }
+  async_planner.wait();
+
+  if (!passed) {
+    printf(ANSI_COLOR_RED "Async planner check failed!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+  printf(ANSI_COLOR_GREEN "Async planner check passed!\n" ANSI_COLOR_RESET);
+  return 0;
+}
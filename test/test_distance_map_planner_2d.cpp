@@ -136,7 +136,7 @@ int main(int argc, char **argv) {
   mapper.map(goal_pt, "fill-opacity:1.0;fill:rgb(255,0,0);", 10); // Red
 
   // Draw the obstacles
-  const auto data = map_util->getMap();
+  const auto data = planner->getPotentialMap();
   for(int x = 0; x < dim(0); x ++) {
     for(int y = 0; y < dim(1); y ++) {
         Vec2f pt = map_util->intToFloat(Vec2i(x, y));
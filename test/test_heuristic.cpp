@@ -0,0 +1,144 @@
+#include <mpl_planner/common/env_base.h>
+#include <random>
+
+// Min effort to reach the goal in time T by brute force: the optimal
+// polynomial of degree 2n-1 is solved from its KKT system
+double brute_force_effort(const Waypoint2D& state, const Waypoint2D& goal,
+                          int n, int k, decimal_t T) {
+  const Vec2f* x0[4] = {&state.pos, &state.vel, &state.acc, &state.jrk};
+  const Vec2f* x1[4] = {&goal.pos, &goal.vel, &goal.acc, &goal.jrk};
+  // coefficient of the r-th derivative of t^p
+  auto coeff = [](int p, int r) {
+    decimal_t v = 1;
+    for (int i = 0; i < r; i++)
+      v *= p - i;
+    return v;
+  };
+
+  const int m = 2 * n;
+  decimal_t J = 0;
+  for (int dim = 0; dim < 2; dim++) {
+    MatDf Q = MatDf::Zero(m, m);
+    for (int p = n; p < m; p++)
+      for (int q = n; q < m; q++)
+        Q(p, q) = coeff(p, n) * coeff(q, n) *
+                  std::pow(T, p + q - 2 * n + 1) / (p + q - 2 * n + 1);
+    MatDf A = MatDf::Zero(n + k, m);
+    VecDf b(n + k);
+    for (int i = 0; i < n; i++) {
+      A(i, i) = coeff(i, i);
+      b(i) = (*x0[i])(dim);
+    }
+    for (int i = 0; i < k; i++) {
+      for (int p = i; p < m; p++)
+        A(n + i, p) = coeff(p, i) * std::pow(T, p - i);
+      b(n + i) = (*x1[i])(dim);
+    }
+    MatDf K = MatDf::Zero(m + n + k, m + n + k);
+    K.topLeftCorner(m, m) = 2 * Q;
+    K.topRightCorner(m, n + k) = A.transpose();
+    K.bottomLeftCorner(n + k, m) = A;
+    VecDf r = VecDf::Zero(m + n + k);
+    r.tail(n + k) = b;
+    const VecDf c = K.fullPivLu().solve(r).head(m);
+    J += c.dot(Q * c);
+  }
+  return J;
+}
+
+// Min effort plus time cost over T >= t_lb: a coarse grid, then a golden
+// section search around its best point
+double brute_force_cost(const Waypoint2D& state, const Waypoint2D& goal,
+                        int n, int k, decimal_t w, decimal_t t_lb) {
+  auto cost = [&](decimal_t T) {
+    return brute_force_effort(state, goal, n, k, T) + w * T;
+  };
+  const decimal_t t0 = std::max<decimal_t>(t_lb, 1e-3), ratio = 1.05;
+  int best = 0;
+  decimal_t min_cost = cost(t0);
+  for (int it = 1; it < 200; it++) {
+    const decimal_t c = cost(t0 * std::pow(ratio, it));
+    if (c < min_cost) {
+      min_cost = c;
+      best = it;
+    }
+  }
+
+  const decimal_t g = (std::sqrt(5.0) - 1) / 2;
+  decimal_t a = best > 0 ? t0 * std::pow(ratio, best - 1) : t0;
+  decimal_t b = t0 * std::pow(ratio, best + 1);
+  for (int it = 0; it < 60; it++) {
+    const decimal_t c = b - g * (b - a), d = a + g * (b - a);
+    if (cost(c) < cost(d))
+      b = d;
+    else
+      a = c;
+  }
+  return std::min(min_cost, cost((a + b) / 2));
+}
+
+struct TestEnv : MPL::env_base<2> {
+  using MPL::env_base<2>::cal_heur_bvp;
+};
+
+int main(int argc, char **argv) {
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<decimal_t> u(-1, 1);
+  auto random_state = [&](Control::Control control) {
+    Waypoint2D w(control);
+    w.pos = Vec2f(5 * u(gen), 5 * u(gen));
+    w.vel = Vec2f(u(gen), u(gen));
+    w.acc = Vec2f(u(gen), u(gen));
+    w.jrk = Vec2f(u(gen), u(gen));
+    return w;
+  };
+
+  const decimal_t w = 10, v_max = 2;
+  TestEnv env;
+  env.set_w(w);
+  env.set_v_max(v_max);
+  env.set_heur_ignore_dynamics(false);
+  const Control::Control goal_control[4] = {Control::VEL, Control::ACC,
+                                            Control::JRK, Control::SNP};
+
+  // The Gramian form against the closed forms of ACC and JRK control
+  decimal_t max_diff = 0;
+  for (int i = 0; i < 200; i++) {
+    for (int n = 2; n <= 3; n++) {
+      const Waypoint2D state = random_state(goal_control[n - 1]);
+      for (int k = 1; k <= n; k++) {
+        const Waypoint2D goal = random_state(goal_control[k - 1]);
+        const decimal_t t_bar =
+          (state.pos - goal.pos).lpNorm<Eigen::Infinity>() / v_max;
+        const decimal_t h = env.cal_heur(state, goal);
+        max_diff = std::max(max_diff,
+            std::abs(env.cal_heur_bvp(state, goal, n, k, t_bar) - h) / h);
+      }
+    }
+  }
+  printf("Max relative difference to closed forms: %g\n", max_diff);
+
+  // Snap control against brute force, the bound should never be higher
+  decimal_t max_over = -1, max_gap = 0;
+  for (int i = 0; i < 20; i++) {
+    const Waypoint2D state = random_state(Control::SNP);
+    for (int k = 1; k <= 4; k++) {
+      const Waypoint2D goal = random_state(goal_control[k - 1]);
+      const decimal_t t_bar =
+        (state.pos - goal.pos).lpNorm<Eigen::Infinity>() / v_max;
+      const decimal_t h = env.cal_heur_bvp(state, goal, 4, k, t_bar);
+      const decimal_t cost = brute_force_cost(state, goal, 4, k, w, t_bar);
+      max_over = std::max(max_over, (h - cost) / cost);
+      max_gap = std::max(max_gap, (cost - h) / cost);
+    }
+  }
+  printf("Snap: max relative excess over brute force: %g, max gap: %g\n",
+         max_over, max_gap);
+
+  if (max_diff > 1e-9 || max_over > 1e-9 || max_gap > 1e-6) {
+    printf(ANSI_COLOR_RED "Heuristic check failed!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+  printf(ANSI_COLOR_GREEN "Heuristic check passed!\n" ANSI_COLOR_RESET);
+  return 0;
+}
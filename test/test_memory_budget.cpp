@@ -0,0 +1,87 @@
+#include "read_map.hpp"
+#include <mpl_planner/planner/map_planner.h>
+
+// Plan with the given memory budget, return the cost of the trajectory or -1
+decimal_t plan(const std::shared_ptr<MPL::OccMapUtil> &map_util,
+               const Waypoint2D &start, const Waypoint2D &goal,
+               const vec_E<VecDf> &U, size_t max_states, size_t &states,
+               int &evicted) {
+  MPL::OccMapPlanner planner(false);
+  planner.setMapUtil(map_util);
+  planner.setVmax(1.0);
+  planner.setAmax(1.0);
+  planner.setDt(1.0);
+  planner.setU(U);
+  planner.setMaxNum(20000);
+  planner.setMemoryBudget(max_states);
+  const bool valid = planner.plan(start, goal);
+  states = planner.getStateNum();
+  evicted = planner.getEvictedNum();
+  if (!valid)
+    return -1;
+  const auto traj = planner.getTraj();
+  return traj.J(static_cast<Control::Control>(start.control & ~1)) +
+         10 * traj.getTotalTime();
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    printf(ANSI_COLOR_RED "Input yaml required!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+
+  // Load the map
+  MapReader<Vec2i, Vec2f> reader(argv[1]);
+  if (!reader.exist()) {
+    printf(ANSI_COLOR_RED "Cannot find input file [%s]!\n" ANSI_COLOR_RESET,
+           argv[1]);
+    return -1;
+  }
+
+  std::shared_ptr<MPL::OccMapUtil> map_util(new MPL::OccMapUtil);
+  map_util->setMap(reader.origin(), reader.dim(), reader.data(),
+                   reader.resolution());
+  map_util->freeUnknown();
+
+  // A budget slightly below the states of the unbounded search should give
+  // the same cost, with vel and acc control
+  bool passed = true;
+  const Control::Control controls[2] = {Control::VEL, Control::ACC};
+  for (const auto control : controls) {
+    Waypoint2D start(control), goal(control);
+    start.pos = Vec2f(reader.start(0), reader.start(1));
+    start.vel = Vec2f::Zero();
+    start.acc = Vec2f::Zero();
+    start.jrk = Vec2f::Zero();
+    goal.pos = Vec2f(reader.goal(0), reader.goal(1));
+    goal.vel = Vec2f::Zero();
+    goal.acc = Vec2f::Zero();
+    goal.jrk = Vec2f::Zero();
+
+    const decimal_t u = control == Control::VEL ? 0.5 : 1.0;
+    vec_E<VecDf> U;
+    for (decimal_t dx = -u; dx <= u; dx += u)
+      for (decimal_t dy = -u; dy <= u; dy += u)
+        U.push_back(Vec2f(dx, dy));
+
+    size_t states, budget_states;
+    int evicted;
+    const decimal_t cost = plan(map_util, start, goal, U, 0, states, evicted);
+    const size_t budget = 0.95 * states;
+    const decimal_t budget_cost =
+        plan(map_util, start, goal, U, budget, budget_states, evicted);
+    printf("%s: %zu states, cost %f; budget %zu: %zu states, %d evicted, "
+           "cost %f\n", control == Control::VEL ? "VEL" : "ACC", states, cost,
+           budget, budget_states, evicted, budget_cost);
+    if (cost < 0 || budget_cost < 0 || evicted == 0 ||
+        std::abs(budget_cost - cost) > 1e-6)
+      passed = false;
+  }
+
+  if (!passed) {
+    printf(ANSI_COLOR_RED "Memory budget check failed!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+  printf(ANSI_COLOR_GREEN "Memory budget check passed!\n" ANSI_COLOR_RESET);
+  return 0;
+}
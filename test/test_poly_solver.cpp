@@ -0,0 +1,172 @@
+#include <mpl_traj_solver/poly_solver.h>
+#include <random>
+
+// Solver that factorizes the system of free derivatives by LU
+struct DenseSolver : PolySolver<2> {
+  using PolySolver<2>::PolySolver;
+  bool solveDense(const vec_E<Waypoint2D>& waypoints,
+                  const std::vector<decimal_t>& dts) {
+    if (!prepare(waypoints, dts))
+      return false;
+    factorizeDense();
+    return solve(waypoints);
+  }
+};
+
+// Coefficients of the optimal polynomials by brute force: the KKT system over
+// the coefficients of all the segments, with the fixed derivatives and the
+// continuity of the smooth ones as constraints
+MatDNf<2> brute_force_coeffs(const vec_E<Waypoint2D>& waypoints,
+                             const std::vector<decimal_t>& dts, int n, int R) {
+  // coefficient of the r-th derivative of t^p
+  auto coeff = [](int p, int r) {
+    decimal_t v = 1;
+    for (int i = 0; i < r; i++)
+      v *= p - i;
+    return v;
+  };
+  auto derivative = [&](int r, decimal_t t) {
+    VecDf row = VecDf::Zero(2 * n);
+    for (int p = r; p < 2 * n; p++)
+      row(p) = coeff(p, r) * std::pow(t, p - r);
+    return row;
+  };
+
+  const int N = 2 * n, S = dts.size();
+  MatDf Q = MatDf::Zero(S * N, S * N);
+  for (int i = 0; i < S; i++)
+    for (int p = R; p < N; p++)
+      for (int q = R; q < N; q++)
+        Q(i * N + p, i * N + q) = coeff(p, R) * coeff(q, R) *
+            std::pow(dts[i], p + q - 2 * R + 1) / (p + q - 2 * R + 1);
+
+  std::vector<VecDf> rows;
+  std::vector<Vec2f> values;
+  for (int k = 0; k <= S; k++) {
+    const Waypoint2D& w = waypoints[k];
+    const Vec2f* value[4] = {&w.pos, &w.vel, &w.acc, &w.jrk};
+    const bool fixed[4] = {w.use_pos, w.use_vel, w.use_acc, w.use_jrk};
+    for (int r = 0; r < n; r++) {
+      if (fixed[r]) {
+        VecDf row = VecDf::Zero(S * N);
+        if (k < S)
+          row.segment(k * N, N) = derivative(r, 0);
+        else
+          row.segment((k - 1) * N, N) = derivative(r, dts[k - 1]);
+        rows.push_back(row);
+        values.push_back(*value[r]);
+      }
+      if (k > 0 && k < S) {
+        VecDf row = VecDf::Zero(S * N);
+        row.segment((k - 1) * N, N) = derivative(r, dts[k - 1]);
+        row.segment(k * N, N) = -derivative(r, 0);
+        rows.push_back(row);
+        values.push_back(Vec2f::Zero());
+      }
+    }
+  }
+
+  const int m = rows.size();
+  MatDf K = MatDf::Zero(S * N + m, S * N + m);
+  K.topLeftCorner(S * N, S * N) = 2 * Q;
+  MatDNf<2> b = MatDNf<2>::Zero(S * N + m, 2);
+  for (int j = 0; j < m; j++) {
+    K.block(S * N + j, 0, 1, S * N) = rows[j].transpose();
+    K.block(0, S * N + j, S * N, 1) = rows[j];
+    b.row(S * N + j) = values[j].transpose();
+  }
+  return K.fullPivLu().solve(b).topRows(S * N);
+}
+
+int main(int argc, char **argv) {
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<decimal_t> u(-1, 1);
+  const Control::Control controls[3] = {Control::VEL, Control::ACC,
+                                        Control::JRK};
+  const int num_waypoints = 40;
+
+  // Band Cholesky and LU against brute force for min vel, acc and jrk, with
+  // random controls at the waypoints
+  decimal_t max_err = 0, max_err_lu = 0;
+  for (int n = 1; n <= 3; n++) {
+    vec_E<Waypoint2D> waypoints;
+    std::vector<decimal_t> dts;
+    for (int k = 0; k < num_waypoints; k++) {
+      const bool end = k == 0 || k + 1 == num_waypoints;
+      Waypoint2D w(end ? controls[n - 1] : controls[gen() % 3]);
+      w.pos = Vec2f(5 * u(gen), 5 * u(gen));
+      w.vel = Vec2f(u(gen), u(gen));
+      w.acc = Vec2f(u(gen), u(gen));
+      w.jrk = Vec2f(u(gen), u(gen));
+      w.yaw = 0;
+      waypoints.push_back(w);
+      if (k > 0)
+        dts.push_back(1.25 + 0.75 * u(gen));
+    }
+
+    const MatDNf<2> p = brute_force_coeffs(waypoints, dts, n, n);
+    const decimal_t scale = p.cwiseAbs().maxCoeff();
+    PolySolver<2> solver(n - 1, n);
+    DenseSolver dense_solver(n - 1, n);
+    if (!solver.solve(waypoints, dts) ||
+        !dense_solver.solveDense(waypoints, dts)) {
+      max_err = std::numeric_limits<decimal_t>::infinity();
+      continue;
+    }
+    max_err = std::max(max_err,
+        (solver.getTrajectory()->p() - p).cwiseAbs().maxCoeff() / scale);
+    max_err_lu = std::max(max_err_lu,
+        (dense_solver.getTrajectory()->p() - p).cwiseAbs().maxCoeff() / scale);
+  }
+  printf("Max relative difference to brute force: band %g, LU %g\n",
+         max_err, max_err_lu);
+
+  // Time optimization of a min jrk trajectory through random points from the
+  // L-inf time allocation, with a range of budgets
+  vec_E<Waypoint2D> waypoints;
+  std::vector<decimal_t> dts;
+  for (int k = 0; k < num_waypoints; k++) {
+    const bool end = k == 0 || k + 1 == num_waypoints;
+    Waypoint2D w(end ? Control::JRK : Control::VEL);
+    w.pos = Vec2f(5 * u(gen), 5 * u(gen));
+    w.vel = w.acc = w.jrk = Vec2f::Zero();
+    w.yaw = 0;
+    if (k > 0)
+      dts.push_back((w.pos - waypoints.back().pos).lpNorm<Eigen::Infinity>());
+    waypoints.push_back(w);
+  }
+  const decimal_t rho = 10;
+  auto objective = [&](const PolySolver<2>& solver,
+                       const std::vector<decimal_t>& ts) {
+    decimal_t f = solver.cost();
+    for (const auto& t : ts)
+      f += rho * t;
+    return f;
+  };
+  PolySolver<2> solver(2, 3);
+  solver.solve(waypoints, dts);
+  const decimal_t f0 = objective(solver, dts);
+  bool time_passed = true;
+  const int budgets[4] = {1, 6, 20, 100};
+  for (const auto& max_solves : budgets) {
+    std::vector<decimal_t> ts = dts;
+    const bool valid = solver.optimizeTime(waypoints, ts, rho, max_solves);
+    // the trajectory on return is the one of the optimized times
+    const decimal_t f = objective(solver, ts);
+    PolySolver<2> check(2, 3);
+    check.solve(waypoints, ts);
+    printf("Time optimization with %d solves: J + rho T %f -> %f, %d solves\n",
+           max_solves, f0, f, solver.getNumSolves());
+    if (!valid || solver.getNumSolves() > max_solves || f > f0 ||
+        (max_solves > 1 && !(f < f0)) ||
+        std::abs(objective(check, ts) - f) > 1e-9 * f)
+      time_passed = false;
+  }
+
+  if (!(max_err < 1e-9) || !(max_err_lu < 1e-9) || !time_passed) {
+    printf(ANSI_COLOR_RED "PolySolver check failed!\n" ANSI_COLOR_RESET);
+    return -1;
+  }
+  printf(ANSI_COLOR_GREEN "PolySolver check passed!\n" ANSI_COLOR_RESET);
+  return 0;
+}